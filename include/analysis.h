@@ -0,0 +1,67 @@
+/**
+ * @file analysis.h
+ *
+ * @section LICENSE License
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <https://unlicense.org>
+ *
+ * @section DESCRIPTION Description
+ *
+ * Function prototypes for monstrominas board analysis.
+ */
+
+#ifndef MONSTROMINAS_ANALYSIS_H
+#define MONSTROMINAS_ANALYSIS_H
+
+#include "monstrominas.h"
+
+#define MINESWEEPER_ANALYSIS_BUDGET     1000000     // Default search budget, in backtracking nodes
+#define MINESWEEPER_ANALYSIS_MAX_VARS       256     // Larger frontier components are always approximated
+
+
+
+/**
+ * Difficulty metrics of a board, see minesweeper_field_metrics().
+ */
+typedef struct MINESWEEPER_METRICS {
+    int bbbv;               // 3BV, the fewest clicks that clear the board without flags
+    int openings;           // Openings, each cleared by one click
+    int isolated;           // Safe cells outside every opening, each needing its own click
+    int opening_cells;      // Safe cells cleared by clicking the openings
+    int mines;
+    int max_clicks_flagging;    // Upper bound on the clicks of a game that flags every mine, see minesweeper_field_metrics()
+} MINESWEEPER_METRICS;
+
+typedef void (*MINESWEEPER_METRICS_CALLBACK)(const MINESWEEPER_FIELD *field, const MINESWEEPER_METRICS *metrics, void *data);
+
+
+
+bool minesweeper_field_probabilities(const MINESWEEPER_FIELD *field, double *probabilities, long budget);
+bool minesweeper_field_safest(const MINESWEEPER_FIELD *field, const double *probabilities, int *row, int *col);
+void minesweeper_field_metrics(const MINESWEEPER_FIELD *field, MINESWEEPER_METRICS *metrics);
+void minesweeper_field_metrics_stream(MINESWEEPER_FIELD *field, int row, int col, long count, MINESWEEPER_METRICS_CALLBACK callback, void *data);
+
+#endif
@@ -33,6 +33,15 @@
  * Typedefs and function prototypes for monstrominas minesweeper.
  */
 
+#ifndef MONSTROMINAS_H
+#define MONSTROMINAS_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "monstrominas_config.h"
+
 #define MINESWEEPER_ROWS        10
 #define MINESWEEPER_COLUMNS     10
 #define MINESWEEPER_MINES       85
@@ -41,15 +50,88 @@
 #define MINESWEEPER_WARNING      2
 #define MINESWEEPER_MIN_RATIO    0.1
 #define MINESWEEPER_MAX_RATIO    0.2
+#define MINESWEEPER_CACHE_LINE  64
+#define MINESWEEPER_CODEC_SEGMENT   256     // Cells per segment of encoded mine layouts
+#define MINESWEEPER_CODEC_WORDS       4     // 64-bit words in the rank of a segment
+#define MINESWEEPER_SAVE_VERSION      1     // Version of the snapshots written by minesweeper_field_save()
+
+
+
+typedef void (*MINESWEEPER_LOG)(const char *format, va_list args);
+
+
+
+/*
+ * Caller owned list of the cells changed by minesweeper_event_uncover() and
+ * minesweeper_event_flag(), attached to a field through its \c changes member.
+ * Events append to \c cells until the caller clears the list, so the buffers
+ * are reused once they have grown. minesweeper_changes_compact() turns the
+ * list into sorted runs of consecutive cells, which is much shorter for large
+ * cascades.
+ */
+typedef struct MINESWEEPER_CHANGES {
+    int *cells;             // Changed cells as row * cols + col, in event order
+    int count;
+    int capacity;
+    int *runs;              // Pairs of first cell and length, see minesweeper_changes_compact()
+    int run_count;
+    int run_capacity;
+} MINESWEEPER_CHANGES;
 
 
 
+/*
+ * Random number generator used to place mines. \c next defaults to 
+ * xoshiro256** but any other 64-bit generator can be plugged in before seeding.
+ */
+typedef struct MINESWEEPER_RNG {
+    uint64_t s[4];
+    uint64_t (*next)(struct MINESWEEPER_RNG *rng);
+} MINESWEEPER_RNG;
+
+
+
+/*
+ * When MINESWEEPER_PACKED is defined (cmake -DWANT_PACKED_FIELD=ON, which 
+ * monstrominas_config.h records) the field stores mines, uncovered cells and 
+ * flags as 64-bit word bitboards, with each row padded to a whole number of 
+ * words, and hints as 4-bit nibbles. That's one byte per cell instead of ten. 
+ * Use the minesweeper_cell_*() accessors below instead of indexing the arrays 
+ * directly so the code works with both layouts.
+ */
 typedef struct MINESWEEPER_FIELD {
 // Core fields
+#ifdef MINESWEEPER_PACKED
+    uint64_t *cells;        // Mines bitboard
+    uint8_t *hints;         // Two hints per byte, even cells in the low nibble
+    uint64_t *state;        // Uncovered cells bitboard
+    uint64_t *flags;        // MINESWEEPER_DANGER flags bitboard
+    uint64_t *warnings;     // MINESWEEPER_WARNING flags bitboard
+    int row_words;          // 64-bit words per bitboard row
+#else
     bool *cells;
     int *hints;
     bool *state;
     int *flags;
+#endif
+    int *queue;             // Flood fill worklist, also the list of cells uncovered by the last move
+    int queue_count;
+    MINESWEEPER_CHANGES *changes;   // Optional list of changed cells, not owned by the field
+    int *shuffle;           // Permutation of all cells used to place mines
+// Openings, see minesweeper_field_label_openings(). The buffers are kept out 
+// of the arena and only allocated the first time a board is labelled.
+    int *openings;          // Opening of every zero-hint cell and of its neighbors, -1 for any other cell
+    int *opening_start;     // Offset of every opening in opening_cells, plus one past the last opening
+    int *opening_cells;     // Cells of every opening, zero-hint cells and border, grouped by opening
+    int opening_count;      // -1 until minesweeper_field_label_openings() labels the board
+    void *opening_arena;    // Allocation holding openings and opening_start
+    size_t opening_arena_size;
+    size_t opening_cells_size;
+    MINESWEEPER_RNG rng;
+    uint64_t seed;
+    float density;          // Mine ratio, 0 to derive it from the field size
+    void *arena;            // Single allocation holding all of the above buffers but the openings
+    size_t arena_size;
     int rows;
     int cols;
     int cell_count;
@@ -58,14 +140,122 @@ typedef struct MINESWEEPER_FIELD {
     int flags_count;
     bool complete;
     int move_count;
+    double time;            // Seconds played, kept by the caller and saved with the game
 } MINESWEEPER_FIELD;
 
 
 
+#ifdef MINESWEEPER_PACKED
+#define MINESWEEPER_WORD(field, row, col)   ((row) * (field)->row_words + ((col) >> 6))
+#define MINESWEEPER_BIT(col)                (UINT64_C(1) << ((col) & 63))
+
+static inline bool minesweeper_cell_mine(const MINESWEEPER_FIELD *field, int row, int col) {
+    return field->cells[MINESWEEPER_WORD(field, row, col)] & MINESWEEPER_BIT(col);
+}
+
+static inline bool minesweeper_cell_uncovered(const MINESWEEPER_FIELD *field, int row, int col) {
+    return field->state[MINESWEEPER_WORD(field, row, col)] & MINESWEEPER_BIT(col);
+}
+
+static inline int minesweeper_cell_hint(const MINESWEEPER_FIELD *field, int row, int col) {
+    int index = row * field->cols + col;
+    return (field->hints[index >> 1] >> ((index & 1) << 2)) & 0x0F;
+}
+
+static inline int minesweeper_cell_flag(const MINESWEEPER_FIELD *field, int row, int col) {
+    int word = MINESWEEPER_WORD(field, row, col);
+    uint64_t bit = MINESWEEPER_BIT(col);
+    return (field->flags[word] & bit) ? MINESWEEPER_DANGER : ((field->warnings[word] & bit) ? MINESWEEPER_WARNING : 0);
+}
+
+static inline void minesweeper_cell_set_mine(MINESWEEPER_FIELD *field, int row, int col, bool mine) {
+    if (mine) field->cells[MINESWEEPER_WORD(field, row, col)] |= MINESWEEPER_BIT(col);
+    else field->cells[MINESWEEPER_WORD(field, row, col)] &= ~MINESWEEPER_BIT(col);
+}
+
+static inline void minesweeper_cell_set_uncovered(MINESWEEPER_FIELD *field, int row, int col, bool uncovered) {
+    if (uncovered) field->state[MINESWEEPER_WORD(field, row, col)] |= MINESWEEPER_BIT(col);
+    else field->state[MINESWEEPER_WORD(field, row, col)] &= ~MINESWEEPER_BIT(col);
+}
+
+static inline void minesweeper_cell_set_hint(MINESWEEPER_FIELD *field, int row, int col, int hint) {
+    int index = row * field->cols + col, shift = (index & 1) << 2;
+    field->hints[index >> 1] = (field->hints[index >> 1] & ~(0x0F << shift)) | (hint << shift);
+}
+
+static inline void minesweeper_cell_set_flag(MINESWEEPER_FIELD *field, int row, int col, int flag) {
+    int word = MINESWEEPER_WORD(field, row, col);
+    uint64_t bit = MINESWEEPER_BIT(col);
+    field->flags[word] = flag == MINESWEEPER_DANGER ? field->flags[word] | bit : field->flags[word] & ~bit;
+    field->warnings[word] = flag == MINESWEEPER_WARNING ? field->warnings[word] | bit : field->warnings[word] & ~bit;
+}
+#else
+static inline bool minesweeper_cell_mine(const MINESWEEPER_FIELD *field, int row, int col) {
+    return field->cells[row * field->cols + col];
+}
+
+static inline bool minesweeper_cell_uncovered(const MINESWEEPER_FIELD *field, int row, int col) {
+    return field->state[row * field->cols + col];
+}
+
+static inline int minesweeper_cell_hint(const MINESWEEPER_FIELD *field, int row, int col) {
+    return field->hints[row * field->cols + col];
+}
+
+static inline int minesweeper_cell_flag(const MINESWEEPER_FIELD *field, int row, int col) {
+    return field->flags[row * field->cols + col];
+}
+
+static inline void minesweeper_cell_set_mine(MINESWEEPER_FIELD *field, int row, int col, bool mine) {
+    field->cells[row * field->cols + col] = mine;
+}
+
+static inline void minesweeper_cell_set_uncovered(MINESWEEPER_FIELD *field, int row, int col, bool uncovered) {
+    field->state[row * field->cols + col] = uncovered;
+}
+
+static inline void minesweeper_cell_set_hint(MINESWEEPER_FIELD *field, int row, int col, int hint) {
+    field->hints[row * field->cols + col] = hint;
+}
+
+static inline void minesweeper_cell_set_flag(MINESWEEPER_FIELD *field, int row, int col, int flag) {
+    field->flags[row * field->cols + col] = flag;
+}
+#endif
+
+
+
+void minesweeper_set_log(MINESWEEPER_LOG log);
+
+void minesweeper_rng_seed(MINESWEEPER_RNG *rng, uint64_t seed);
+uint64_t minesweeper_rng_xoshiro(MINESWEEPER_RNG *rng);
+uint32_t minesweeper_rng_range(MINESWEEPER_RNG *rng, uint32_t n);
+
 void minesweeper_field_print(MINESWEEPER_FIELD *field);
 MINESWEEPER_FIELD *minesweeper_field_create(int rows, int cols);
+MINESWEEPER_FIELD *minesweeper_field_create_seeded(int rows, int cols, uint64_t seed);
+void minesweeper_field_resize(MINESWEEPER_FIELD *field, int rows, int cols);
+void minesweeper_field_reset(MINESWEEPER_FIELD *field, int row, int col, bool reset_flags);
+void minesweeper_field_generate(MINESWEEPER_FIELD *field, int row, int col, bool reset_flags);
+void minesweeper_field_copy_mines(MINESWEEPER_FIELD *field, const MINESWEEPER_FIELD *source, bool reset_flags);
+void minesweeper_field_label_openings(MINESWEEPER_FIELD *field);
+size_t minesweeper_field_encode_mines(const MINESWEEPER_FIELD *field, uint8_t *buffer, size_t size);
+bool minesweeper_field_decode_mines(MINESWEEPER_FIELD *field, const uint8_t *buffer, size_t size, bool reset_flags);
+size_t minesweeper_field_save(const MINESWEEPER_FIELD *field, uint8_t *buffer, size_t size);
+bool minesweeper_field_load(MINESWEEPER_FIELD *field, const uint8_t *buffer, size_t size);
+size_t minesweeper_field_save_bound(const MINESWEEPER_FIELD *field);
+bool minesweeper_save_write_file(const char *path, const uint8_t *buffer, size_t size);
+bool minesweeper_field_save_file(const MINESWEEPER_FIELD *field, const char *path);
+bool minesweeper_field_load_file(MINESWEEPER_FIELD *field, const char *path);
+void minesweeper_field_seed(MINESWEEPER_FIELD *field, uint64_t seed);
 void minesweeper_field_destroy(MINESWEEPER_FIELD *field);
 void minesweeper_field_uncover(MINESWEEPER_FIELD *field, int row, int col);
 bool minesweeper_event_uncover(MINESWEEPER_FIELD *field, int row, int col);
 void minesweeper_event_flag(MINESWEEPER_FIELD *field, int row, int col);
 
+MINESWEEPER_CHANGES *minesweeper_changes_create();
+void minesweeper_changes_destroy(MINESWEEPER_CHANGES *changes);
+void minesweeper_changes_clear(MINESWEEPER_CHANGES *changes);
+void minesweeper_changes_compact(MINESWEEPER_CHANGES *changes);
+
+#endif
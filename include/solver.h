@@ -0,0 +1,80 @@
+/**
+ * @file solver.h
+ *
+ * @section LICENSE License
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <https://unlicense.org>
+ *
+ * @section DESCRIPTION Description
+ *
+ * Typedefs and function prototypes for the monstrominas constraint solver.
+ */
+
+#ifndef MONSTROMINAS_SOLVER_H
+#define MONSTROMINAS_SOLVER_H
+
+#include "monstrominas.h"
+
+#define MINESWEEPER_SOLVER_UNKNOWN  0
+#define MINESWEEPER_SOLVER_SAFE     1
+#define MINESWEEPER_SOLVER_MINE     2
+#define MINESWEEPER_SOLVER_MAX_THREADS  64
+
+
+
+/*
+ * Incremental deduction state for a field. Only what the player can see is
+ * used: uncovered cells and their hints. Player flags may be wrong, so they
+ * aren't taken into account.
+ */
+typedef struct MINESWEEPER_SOLVER {
+    MINESWEEPER_FIELD *field;
+    uint8_t *known;         // MINESWEEPER_SOLVER_* state of every cell
+    uint8_t *queued;        // Whether a cell is waiting in the work queue
+    int *work;              // Circular queue of uncovered cells whose constraint changed
+    int work_head;
+    int work_count;
+    int *safe;              // Covered cells deduced to be safe, in order of discovery
+    int safe_count;
+    int safe_next;          // Next safe cell returned by minesweeper_solver_next_safe()
+    int *mines;             // Cells deduced to be mines, in order of discovery
+    int mine_count;
+    void *arena;
+    size_t arena_size;
+} MINESWEEPER_SOLVER;
+
+
+
+MINESWEEPER_SOLVER *minesweeper_solver_create(MINESWEEPER_FIELD *field);
+void minesweeper_solver_destroy(MINESWEEPER_SOLVER *solver);
+void minesweeper_solver_reset(MINESWEEPER_SOLVER *solver);
+void minesweeper_solver_update(MINESWEEPER_SOLVER *solver, const int *cells, int count);
+bool minesweeper_solver_next_safe(MINESWEEPER_SOLVER *solver, int *row, int *col);
+bool minesweeper_solver_play(MINESWEEPER_SOLVER *solver, int row, int col);
+
+bool minesweeper_field_reset_noguess(MINESWEEPER_FIELD *field, int row, int col, bool reset_flags, int threads, int max_attempts, double max_seconds);
+
+#endif
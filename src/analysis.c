@@ -0,0 +1,664 @@
+/**
+ * @file analysis.c
+ *
+ * @section LICENSE License
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <https://unlicense.org>
+ *
+ * @section DESCRIPTION Description
+ *
+ * Board analysis: exact mine probabilities for the covered cells of a field
+ * and difficulty metrics of a board.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "analysis.h"
+
+
+
+#define ANALYSIS_MAX_CONSTRAINTS    8       // Constraints around a cell, and cells around a constraint
+#define ANALYSIS_EXACT_WORK     50000000.   // Above this, components are combined assuming independence
+
+
+
+/*
+ * Probability analysis state. Constraints are the uncovered cells next to a
+ * covered one. Variables are groups of covered cells next to exactly the same
+ * constraints, which only matter by the number of mines they hold.
+ */
+typedef struct ANALYSIS {
+    int *var_of;                // Variable of every frontier cell
+    int *var_size;              // Cells in every variable
+    int *var_cons;              // Constraints of every variable, in increasing order
+    int *var_con_count;
+    int var_count;
+    int *con_target;            // Mines around every constraint
+    int *con_mines;             // Mines assigned around every constraint
+    int *con_free;              // Unassigned cells around every constraint
+    int *con_vars;              // Variables around every constraint
+    int *con_var_count;
+    int con_count;
+
+// Component enumeration
+    int *order;                 // Variables grouped by component, in enumeration order
+    int first;                  // Variables of the component being enumerated
+    int count;
+    int *assigned;              // Mines assigned to every variable of the component
+    int mines;                  // Total mines in the field
+    double *solutions;          // Weighted solutions by number of mines
+    double *mine_solutions;     // Weighted mines in every variable, by number of mines
+    long nodes;
+    long budget;
+    bool aborted;
+} ANALYSIS;
+
+/*
+ * Enumeration result for one frontier component, scaled so the largest
+ * weight is 1.
+ */
+typedef struct ANALYSIS_COMPONENT {
+    int first;                  // Position of the first variable in ANALYSIS.order
+    int count;
+    int cells;
+    double *weights;            // cells + 1 entries
+    double *mine_weights;       // (cells + 1) * count entries
+    double *factors;            // Weight of the rest of the board for every mine count
+} ANALYSIS_COMPONENT;
+
+static const double analysis_choose[ANALYSIS_MAX_CONSTRAINTS + 1][ANALYSIS_MAX_CONSTRAINTS + 1] = {
+    {1}, {1, 1}, {1, 2, 1}, {1, 3, 3, 1}, {1, 4, 6, 4, 1}, {1, 5, 10, 10, 5, 1},
+    {1, 6, 15, 20, 15, 6, 1}, {1, 7, 21, 35, 35, 21, 7, 1}, {1, 8, 28, 56, 70, 56, 28, 8, 1}
+};
+
+
+
+/*
+ * Depth-first enumeration of the mine assignments of a component. Each
+ * constraint keeps its count of assigned mines and of unassigned cells, so a
+ * branch is cut as soon as a constraint can't be met any more. A variable
+ * holding m mines out of its n cells stands for C(n, m) assignments.
+ */
+static void analysis_enumerate(ANALYSIS *analysis, int depth, int mines, double weight) {
+    if (analysis->aborted || ++analysis->nodes > analysis->budget) {
+        analysis->aborted = true;
+        return;
+    }
+    if (depth == analysis->count) {
+        analysis->solutions[mines] += weight;
+        for (int i = 0; i < analysis->count; i++)
+            if (analysis->assigned[i])
+                analysis->mine_solutions[mines * analysis->count + i] += weight * analysis->assigned[i];
+        return;
+    }
+
+    int var = analysis->order[analysis->first + depth], size = analysis->var_size[var];
+    int *cons = analysis->var_cons + var * ANALYSIS_MAX_CONSTRAINTS;
+    for (int value = 0; value <= size && mines + value <= analysis->mines; value++) {
+        bool valid = true;
+        for (int k = 0; k < analysis->var_con_count[var] && valid; k++) {
+            int con = cons[k];
+            int assigned = analysis->con_mines[con] + value;
+            valid = assigned <= analysis->con_target[con] && assigned + analysis->con_free[con] - size >= analysis->con_target[con];
+        }
+        if (!valid) continue;
+
+        for (int k = 0; k < analysis->var_con_count[var]; k++) {
+            analysis->con_mines[cons[k]] += value;
+            analysis->con_free[cons[k]] -= size;
+        }
+        analysis->assigned[depth] = value;
+        analysis_enumerate(analysis, depth + 1, mines + value, weight * analysis_choose[size][value]);
+        for (int k = 0; k < analysis->var_con_count[var]; k++) {
+            analysis->con_mines[cons[k]] -= value;
+            analysis->con_free[cons[k]] += size;
+        }
+    }
+}
+
+
+
+/*
+ * Fallback for components that are too large or too expensive to enumerate:
+ * every cell gets the average mine density of its constraints, and the
+ * component is assumed to hold the rounded sum of those.
+ */
+static void analysis_approximate(ANALYSIS *analysis, ANALYSIS_COMPONENT *component) {
+    int count = component->count;
+    double expected = 0;
+    double *p = component->mine_weights;
+
+    for (int i = 0; i < count; i++) {
+        int var = analysis->order[component->first + i];
+        double sum = 0;
+        for (int k = 0; k < analysis->var_con_count[var]; k++) {
+            int con = analysis->var_cons[var * ANALYSIS_MAX_CONSTRAINTS + k];
+            sum += (double)analysis->con_target[con] / analysis->con_free[con];
+        }
+        p[i] = sum / analysis->var_con_count[var];
+        p[i] = analysis->var_size[var] * (p[i] > 1 ? 1 : p[i]);
+        expected += p[i];
+    }
+
+    int mines = (int)(expected + 0.5);
+    memset(component->weights, 0, (component->cells + 1) * sizeof(double));
+    component->weights[mines] = 1;
+    if (mines > 0) {
+        memmove(p + mines * count, p, count * sizeof(double));
+        memset(p, 0, mines * count * sizeof(double));
+    }
+}
+
+
+
+/*
+ * log(n choose k), -INFINITY when k is out of range.
+ */
+static double analysis_log_choose(int n, int k) {
+    if (k < 0 || k > n) return -INFINITY;
+    return lgamma(n + 1.) - lgamma(k + 1.) - lgamma(n - k + 1.);
+}
+
+
+
+static void analysis_convolve(const double *a, int a_length, const double *b, int b_length, double *out, int length) {
+    memset(out, 0, length * sizeof(double));
+    for (int i = 0; i < a_length && i < length; i++)
+        if (a[i] != 0)
+            for (int j = 0; j < b_length && i + j < length; j++)
+                out[i + j] += a[i] * b[j];
+}
+
+
+
+/*
+ * Fallback when there's no memory for the analysis: every covered cell gets 
+ * the density of the mines over the covered cells.
+ */
+static bool analysis_uniform(const MINESWEEPER_FIELD *field, double *probabilities) {
+    int rows = field->rows, cols = field->cols, covered = 0;
+
+    for (int row = 0; row < rows; row++)
+        for (int col = 0; col < cols; col++)
+            covered += !minesweeper_cell_uncovered(field, row, col);
+    for (int row = 0; row < rows; row++)
+        for (int col = 0; col < cols; col++)
+            probabilities[row * cols + col] = minesweeper_cell_uncovered(field, row, col) ? 0 : (double)field->mine_count / covered;
+    return false;
+}
+
+
+
+/**
+ * Computes the probability of every cell of the field being a mine, as seen by
+ * the player: only uncovered cells and their hints (and the total number of
+ * mines) are taken into account. Uncovered cells get a probability of 0.
+ *
+ * The covered cells next to uncovered ones are split in independent frontier
+ * components and every component's solutions are enumerated by backtracking,
+ * counting them by number of mines. The components are then combined with
+ * the C(interior, mines left) ways of placing the remaining mines in the
+ * unconstrained interior.
+ *
+ * Enumeration stops after \c budget backtracking nodes in total; components
+ * that don't fit in the budget or have more than
+ * MINESWEEPER_ANALYSIS_MAX_VARS variables are approximated, as is the
+ * combination step on very large boards.
+ *
+ * The working memory grows with the frontier and the constraints around it, 
+ * not with the board, and \c probabilities holds the frontier cell of every 
+ * cell until the results are written. If even that memory can't be 
+ * allocated, every covered cell gets the same probability.
+ *
+ * @return \c true if the probabilities are exact
+ */
+bool minesweeper_field_probabilities(const MINESWEEPER_FIELD *field, double *probabilities, long budget) {
+    int rows = field->rows, cols = field->cols;
+    ANALYSIS analysis = {0};
+    bool exact = true;
+
+    analysis.mines = field->mine_count;
+    analysis.budget = budget > 0 ? budget : MINESWEEPER_ANALYSIS_BUDGET;
+
+// Count the frontier cells and the constraints to size the working memory, 
+// marking every cell as outside the frontier
+    int interior = 0, frontier = 0, constraints = 0;
+    for (int row = 0; row < rows; row++)
+        for (int col = 0; col < cols; col++) {
+            bool uncovered = minesweeper_cell_uncovered(field, row, col), border = false;
+            for (int j = row - 1; j <= row + 1 && !border; j++)
+                for (int i = col - 1; i <= col + 1 && !border; i++)
+                    border = j >= 0 && j < rows && i >= 0 && i < cols && minesweeper_cell_uncovered(field, j, i) != uncovered;
+            constraints += uncovered && border;
+            frontier += !uncovered && border;
+            interior += !uncovered && !border;
+            probabilities[row * cols + col] = -1;
+        }
+
+    size_t frontier_size = frontier + 1, constraint_size = constraints + 1;
+    int *arrays = calloc(frontier_size * (7 + 2 * ANALYSIS_MAX_CONSTRAINTS) + constraint_size * (4 + ANALYSIS_MAX_CONSTRAINTS), sizeof(int));
+    if (!arrays) return analysis_uniform(field, probabilities);
+    analysis.var_of = arrays;
+    analysis.var_size = analysis.var_of + frontier_size;
+    analysis.var_cons = analysis.var_size + frontier_size;
+    analysis.var_con_count = analysis.var_cons + frontier_size * ANALYSIS_MAX_CONSTRAINTS;
+    analysis.order = analysis.var_con_count + frontier_size;
+    analysis.assigned = analysis.order + frontier_size;
+    int *cell_cons = analysis.assigned + frontier_size;
+    int *cell_con_count = cell_cons + frontier_size * ANALYSIS_MAX_CONSTRAINTS;
+    int *frontier_cell = cell_con_count + frontier_size;
+    analysis.con_target = frontier_cell + frontier_size;
+    analysis.con_mines = analysis.con_target + constraint_size;
+    analysis.con_free = analysis.con_mines + constraint_size;
+    analysis.con_vars = analysis.con_free + constraint_size;
+    analysis.con_var_count = analysis.con_vars + constraint_size * ANALYSIS_MAX_CONSTRAINTS;
+
+// Find the constraints and the covered cells around them
+    frontier = 0;
+    for (int row = 0; row < rows; row++)
+        for (int col = 0; col < cols; col++) {
+            if (!minesweeper_cell_uncovered(field, row, col)) continue;
+            int con = analysis.con_count;
+            for (int j = row - 1; j <= row + 1; j++) {
+                if (j < 0 || j >= rows) continue;
+                for (int i = col - 1; i <= col + 1; i++) {
+                    if (i < 0 || i >= cols || minesweeper_cell_uncovered(field, j, i)) continue;
+                    int cell = j * cols + i, f = (int)probabilities[cell];
+                    if (f < 0) {
+                        f = frontier++;
+                        probabilities[cell] = f;
+                        frontier_cell[f] = cell;
+                    }
+                    cell_cons[f * ANALYSIS_MAX_CONSTRAINTS + cell_con_count[f]++] = con;
+                    analysis.con_vars[con * ANALYSIS_MAX_CONSTRAINTS + analysis.con_var_count[con]++] = f;
+                    analysis.con_free[con]++;
+                }
+            }
+            if (analysis.con_var_count[con] > 0)
+                analysis.con_target[analysis.con_count++] = minesweeper_cell_hint(field, row, col);
+        }
+
+// Merge cells with the same constraints into variables. Such cells share
+// their first constraint, so only the cells around it need to be compared.
+    for (int f = 0; f < frontier; f++) {
+        int *cons = cell_cons + f * ANALYSIS_MAX_CONSTRAINTS, count = cell_con_count[f];
+        int var = -1;
+        for (int k = 0; k < analysis.con_var_count[cons[0]] && var < 0; k++) {
+            int other = analysis.con_vars[cons[0] * ANALYSIS_MAX_CONSTRAINTS + k];
+            if (other < f && cell_con_count[other] == count &&
+                    !memcmp(cell_cons + other * ANALYSIS_MAX_CONSTRAINTS, cons, count * sizeof(int)))
+                var = analysis.var_of[other];
+        }
+        if (var < 0) {
+            var = analysis.var_count++;
+            memcpy(analysis.var_cons + var * ANALYSIS_MAX_CONSTRAINTS, cons, count * sizeof(int));
+            analysis.var_con_count[var] = count;
+        }
+        analysis.var_size[var]++;
+        analysis.var_of[f] = var;
+    }
+    for (int con = 0; con < analysis.con_count; con++)
+        analysis.con_var_count[con] = 0;
+    for (int var = 0; var < analysis.var_count; var++)
+        for (int k = 0; k < analysis.var_con_count[var]; k++) {
+            int con = analysis.var_cons[var * ANALYSIS_MAX_CONSTRAINTS + k];
+            analysis.con_vars[con * ANALYSIS_MAX_CONSTRAINTS + analysis.con_var_count[con]++] = var;
+        }
+
+// Group the variables by component, in breadth-first order through their
+// constraints so that constraints are closed as early as possible
+    int component_count = 0, ordered = 0;
+    ANALYSIS_COMPONENT *components = calloc(analysis.var_count + 1, sizeof(ANALYSIS_COMPONENT));
+    char *visited = calloc(analysis.var_count + 1, 1);
+    if (!components || !visited) {
+        free(components);
+        free(visited);
+        free(arrays);
+        return analysis_uniform(field, probabilities);
+    }
+    for (int var = 0; var < analysis.var_count; var++) {
+        if (visited[var]) continue;
+        ANALYSIS_COMPONENT *component = &components[component_count++];
+        component->first = ordered;
+        visited[var] = true;
+        analysis.order[ordered++] = var;
+        for (int head = component->first; head < ordered; head++) {
+            int current = analysis.order[head];
+            component->cells += analysis.var_size[current];
+            for (int k = 0; k < analysis.var_con_count[current]; k++) {
+                int con = analysis.var_cons[current * ANALYSIS_MAX_CONSTRAINTS + k];
+                for (int v = 0; v < analysis.con_var_count[con]; v++) {
+                    int next = analysis.con_vars[con * ANALYSIS_MAX_CONSTRAINTS + v];
+                    if (visited[next]) continue;
+                    visited[next] = true;
+                    analysis.order[ordered++] = next;
+                }
+            }
+        }
+        component->count = ordered - component->first;
+    }
+    free(visited);
+
+// The weights of all the components, then the probability of every variable
+    size_t weight_size = analysis.var_count + 1;
+    for (int c = 0; c < component_count; c++)
+        weight_size += (size_t)(components[c].cells + 1) * (components[c].count + 2);
+    double *weights = calloc(weight_size, sizeof(double));
+    if (!weights) {
+        free(components);
+        free(arrays);
+        return analysis_uniform(field, probabilities);
+    }
+    double *var_probabilities = weights;
+    for (int c = 0, position = analysis.var_count + 1; c < component_count; c++) {
+        int span = components[c].cells + 1;
+        components[c].weights = weights + position;
+        components[c].factors = components[c].weights + span;
+        components[c].mine_weights = components[c].factors + span;
+        position += span * (components[c].count + 2);
+    }
+
+// Enumerate every component
+    for (int c = 0; c < component_count; c++) {
+        ANALYSIS_COMPONENT *component = &components[c];
+        int count = component->count, span = component->cells + 1;
+
+        analysis.aborted = count > MINESWEEPER_ANALYSIS_MAX_VARS;
+        if (!analysis.aborted) {
+            analysis.first = component->first;
+            analysis.count = count;
+            analysis.solutions = component->weights;
+            analysis.mine_solutions = component->mine_weights;
+            analysis_enumerate(&analysis, 0, 0, 1);
+        }
+
+        double largest = 0;
+        if (!analysis.aborted)
+            for (int k = 0; k < span; k++)
+                largest = component->weights[k] > largest ? component->weights[k] : largest;
+        if (largest == 0) {
+            exact = false;
+            analysis_approximate(&analysis, component);
+            continue;
+        }
+        for (int k = 0; k < span; k++) {
+            component->weights[k] /= largest;
+            for (int i = 0; i < count; i++)
+                component->mine_weights[k * count + i] /= largest;
+        }
+    }
+
+// Combine the components with the interior. factors[k] is the weight of all
+// the ways of placing the other mines when a component holds k mines.
+    int mines = analysis.mines, span = mines + 1;
+    double interior_mines = 0, total = 0;
+    double work = (double)component_count * span * span;
+    double *binomial = work <= ANALYSIS_EXACT_WORK ? malloc((size_t)(2 * component_count + 4) * span * sizeof(double)) : NULL;
+    if (binomial) {
+        double *prefix = binomial + span;
+        double *suffix = prefix + (size_t)(component_count + 1) * span;
+        double *others = suffix + (size_t)(component_count + 1) * span;
+
+        double largest = -INFINITY;
+        for (int r = 0; r < span; r++) {
+            binomial[r] = analysis_log_choose(interior, r);
+            largest = binomial[r] > largest ? binomial[r] : largest;
+        }
+        for (int r = 0; r < span; r++)
+            binomial[r] = exp(binomial[r] - largest);
+
+        memset(prefix, 0, span * sizeof(double));
+        memset(suffix + component_count * span, 0, span * sizeof(double));
+        prefix[0] = suffix[component_count * span] = 1;
+        for (int c = 0; c < component_count; c++)
+            analysis_convolve(prefix + c * span, span, components[c].weights, components[c].cells + 1, prefix + (c + 1) * span, span);
+        for (int c = component_count - 1; c >= 0; c--)
+            analysis_convolve(suffix + (c + 1) * span, span, components[c].weights, components[c].cells + 1, suffix + c * span, span);
+
+        for (int k = 0; k < span; k++) {
+            double weight = prefix[component_count * span + k] * binomial[mines - k];
+            total += weight;
+            interior_mines += weight * (mines - k);
+        }
+        interior_mines = total > 0 ? interior_mines / total : 0;
+
+        for (int c = 0; c < component_count; c++) {
+            analysis_convolve(prefix + c * span, span, suffix + (c + 1) * span, span, others, span);
+            for (int k = 0; k <= components[c].cells && k < span; k++)
+                for (int rest = 0; rest + k < span; rest++)
+                    components[c].factors[k] += others[rest] * binomial[mines - k - rest];
+        }
+        free(binomial);
+    }
+    else {
+    // Too much work or no memory for it: assume the components are independent, 
+    // each mine costing the odds of the interior density, and iterate to a 
+    // consistent density
+        exact = false;
+        double density = interior > 0 ? (double)mines / (interior + frontier) : 0;
+        for (int iteration = 0; iteration < 8; iteration++) {
+            double odds = density > 0 && density < 1 ? log(density / (1 - density)) : 0, expected = 0;
+            for (int c = 0; c < component_count; c++) {
+                double sum = 0, mean = 0, largest = -INFINITY;
+                for (int k = 0; k <= components[c].cells; k++)
+                    largest = k * odds > largest ? k * odds : largest;
+                for (int k = 0; k <= components[c].cells; k++) {
+                    components[c].factors[k] = exp(k * odds - largest);
+                    sum += components[c].weights[k] * components[c].factors[k];
+                    mean += k * components[c].weights[k] * components[c].factors[k];
+                }
+                expected += sum > 0 ? mean / sum : 0;
+            }
+            density = interior > 0 ? (mines - expected) / interior : 0;
+            density = density < 0 ? 0 : (density > 1 ? 1 : density);
+        }
+        interior_mines = density * interior;
+    }
+
+// Write the probabilities
+    for (int c = 0; c < component_count; c++) {
+        ANALYSIS_COMPONENT *component = &components[c];
+        double sum = 0;
+        for (int k = 0; k <= component->cells; k++)
+            sum += component->weights[k] * component->factors[k];
+        for (int i = 0; i < component->count; i++) {
+            int var = analysis.order[component->first + i];
+            double p = 0;
+            for (int k = 0; k <= component->cells; k++)
+                p += component->mine_weights[k * component->count + i] * component->factors[k];
+            var_probabilities[var] = sum > 0 ? p / sum / analysis.var_size[var] : 0;
+        }
+    }
+    double interior_probability = interior > 0 ? interior_mines / interior : 0;
+    for (int row = 0; row < rows; row++)
+        for (int col = 0; col < cols; col++)
+            probabilities[row * cols + col] = minesweeper_cell_uncovered(field, row, col) ? 0 : interior_probability;
+    for (int f = 0; f < frontier; f++)
+        probabilities[frontier_cell[f]] = var_probabilities[analysis.var_of[f]];
+
+    free(weights);
+    free(components);
+    free(arrays);
+
+    return exact;
+}
+
+
+
+/**
+ * Finds the covered cell least likely to be a mine according to \c probabilities,
+ * as computed by minesweeper_field_probabilities().
+ *
+ * @return \c false if there are no covered cells
+ */
+bool minesweeper_field_safest(const MINESWEEPER_FIELD *field, const double *probabilities, int *row, int *col) {
+    double best = 2;
+
+    for (int j = 0; j < field->rows; j++)
+        for (int i = 0; i < field->cols; i++) {
+            if (minesweeper_cell_uncovered(field, j, i) || probabilities[j * field->cols + i] >= best) continue;
+            best = probabilities[j * field->cols + i];
+            *row = j;
+            *col = i;
+        }
+
+    return best <= 1;
+}
+
+
+
+
+/**
+ * Finds the root of \c run in the union-find \c parent, halving the path.
+ */
+static int analysis_find(int *parent, int run) {
+    while (parent[run] != run)
+        run = parent[run] = parent[parent[run]];
+    return run;
+}
+
+
+
+/**
+ * Computes the difficulty metrics of the board, regardless of the cells 
+ * uncovered so far. 3BV is the number of openings plus the number of safe 
+ * cells that don't belong to any of them. A game that flags every mine can 
+ * always be won with one click per mine plus 3BV, but chording on the flags 
+ * often saves clicks, so that sum is only an upper bound.
+ *
+ * This doesn't label the openings, which costs several times as much as 
+ * generating the board. It's a single pass in row-major order that keeps 
+ * three rows of scratch. The cells cleared by the openings are those within 
+ * one cell of a zero-hint cell, which are never mines, so they're counted 
+ * with the horizontal neighborhoods of zero-hint cells of three consecutive 
+ * rows. The openings are the 8-connected regions of zero-hint cells, counted 
+ * as the runs of zero-hint cells minus the merges of a union-find between 
+ * the runs of each row and the previous one. Only the regions that reach the 
+ * previous row are kept, renumbered after every row.
+ */
+void minesweeper_field_metrics(const MINESWEEPER_FIELD *field, MINESWEEPER_METRICS *metrics) {
+    int rows = field->rows, cols = field->cols, width = cols + 2, most = (cols + 1) / 2 + 1;
+    char *scratch = malloc(4 * (size_t)width + 10 * (size_t)most * sizeof(int));
+    assert(scratch);
+    int *run_start = (int*)scratch, *run_end = run_start + 2 * most, *run_root = run_end + 2 * most;
+    int *parent = run_root + 2 * most, *renumber = parent + 2 * most;
+    unsigned char *zero = (unsigned char*)(renumber + 2 * most), *near[3];
+    int previous = 0, last_count = 0, opening_cells = 0;
+    long runs = 0, merges = 0;
+
+    near[0] = zero + width;
+    near[1] = near[0] + width;
+    near[2] = near[1] + width;
+    memset(zero, 0, 4 * (size_t)width);
+
+// Row j is read into zero[] and its neighborhoods into near[j % 3], so row 
+// j - 1 can be counted once its neighborhoods below are known
+    for (int j = 0; j <= rows; j++) {
+        unsigned char *below = near[j % 3], *here = near[(j + 2) % 3], *above = near[(j + 1) % 3];
+        int count = 0, base = previous;
+
+        if (j < rows) {
+            for (int i = 0; i < cols; i++)
+                zero[i + 1] = !minesweeper_cell_mine(field, j, i) & (minesweeper_cell_hint(field, j, i) == 0);
+            for (int i = 0; i < cols; i++)
+                below[i] = zero[i] | zero[i + 1] | zero[i + 2];
+        }
+        else memset(below, 0, cols);
+        if (j > 0)
+            for (int i = 0; i < cols; i++)
+                opening_cells += above[i] | here[i] | below[i];
+        if (j == rows) break;
+
+// The runs of the previous row are the first ones, with their regions 
+// renumbered from 0, and the runs of this row follow
+        int *start = run_start + (j & 1 ? most : 0), *end = run_end + (j & 1 ? most : 0), *root = run_root + (j & 1 ? most : 0);
+        int *last_start = run_start + (j & 1 ? 0 : most), *last_end = run_end + (j & 1 ? 0 : most), *last_root = run_root + (j & 1 ? 0 : most);
+
+        for (int i = 0; i < cols; i++) {
+            if (!zero[i + 1]) continue;
+            start[count] = i;
+            while (i < cols && zero[i + 1]) i++;
+            end[count] = i - 1;
+            parent[base + count] = base + count;
+            count++;
+        }
+        for (int k = 0; k < base; k++)
+            parent[k] = k;
+        runs += count;
+
+// Runs touch when they overlap once this row's runs are widened by a cell on 
+// each side, and both lists are sorted, so they're merged like sorted lists
+        for (int a = 0, b = 0; a < last_count && b < count; ) {
+            if (last_start[a] <= end[b] + 1 && start[b] - 1 <= last_end[a]) {
+                int x = analysis_find(parent, last_root[a]), y = analysis_find(parent, base + b);
+                if (x != y) {
+                    parent[x > y ? x : y] = x < y ? x : y;
+                    merges++;
+                }
+            }
+            if (last_end[a] < end[b] + 1) a++;
+            else b++;
+        }
+
+        for (int k = 0; k < base + count; k++)
+            renumber[k] = -1;
+        previous = 0;
+        for (int b = 0; b < count; b++) {
+            int r = analysis_find(parent, base + b);
+            if (renumber[r] < 0) renumber[r] = previous++;
+            root[b] = renumber[r];
+        }
+        last_count = count;
+    }
+    free(scratch);
+
+    metrics->mines = field->mine_count;
+    metrics->openings = (int)(runs - merges);
+    metrics->opening_cells = opening_cells;
+    metrics->isolated = rows * cols - field->mine_count - opening_cells;
+    metrics->bbbv = metrics->openings + metrics->isolated;
+    metrics->max_clicks_flagging = metrics->bbbv + metrics->mines;
+}
+
+
+
+/**
+ * Generates \c count boards on \c field, one after the other, with the first 
+ * move at (row, col), and passes the metrics of every board to \c callback. 
+ * Only one board is held at a time, so corpora of any size can be ranked or 
+ * filtered, keeping the boards of interest from the callback.
+ */
+void minesweeper_field_metrics_stream(MINESWEEPER_FIELD *field, int row, int col, long count, MINESWEEPER_METRICS_CALLBACK callback, void *data) {
+    MINESWEEPER_METRICS metrics;
+
+    for (long board = 0; board < count; board++) {
+        minesweeper_field_generate(field, row, col, true);
+        minesweeper_field_metrics(field, &metrics);
+        callback(field, &metrics, data);
+    }
+}
@@ -0,0 +1,286 @@
+/**
+ * @file bench_monstrominas.c
+ *
+ * @section LICENSE License
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <https://unlicense.org>
+ *
+ * @section DESCRIPTION Description
+ *
+ * Microbenchmarks for the minesweeper engine. Results are printed to stdout
+ * as JSON, one object per operation and board size:
+ *
+ *     bench_monstrominas [max_size] [min_seconds]
+ *
+ * Boards are square and range from 10x10 up to \c max_size (10000 by
+ * default). Allocations are counted by wrapping malloc() and friends at link
+ * time, which only sees the engine when it's linked statically.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "monstrominas.h"
+#include "analysis.h"
+
+
+
+static const int sizes[] = {10, 30, 100, 300, 1000, 3000, 10000};
+static long allocations = 0;
+static bool first_result = true;
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+
+
+static double bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+static void bench_report(const char *name, int size, long ops, double cells, double seconds, long allocs) {
+    printf("%s\n    {\"name\": \"%s\", \"rows\": %d, \"cols\": %d, \"ops\": %ld, \"ns_per_op\": %.2f, \"cells_per_second\": %.0f, \"allocs_per_op\": %.3f}",
+            first_result ? "" : ",", name, size, size, ops, seconds * 1e9 / ops, cells / seconds, (double)allocs / ops);
+    first_result = false;
+    fflush(stdout);
+}
+
+
+
+/*
+ * Every benchmark repeats its operation until at least min_seconds of timed
+ * work have been measured. Setup work (resetting the board between cascades,
+ * for instance) is left out of the timings.
+ */
+static void bench_create(int size, double min_seconds) {
+    long ops = 0, allocs = 0;
+    double elapsed = 0;
+
+    while (elapsed < min_seconds) {
+        long before = allocations;
+        double start = bench_now();
+        MINESWEEPER_FIELD *field = minesweeper_field_create(size, size);
+        elapsed += bench_now() - start;
+        allocs += allocations - before;
+        minesweeper_field_destroy(field);
+        ops++;
+    }
+    bench_report("create", size, ops, (double)ops * size * size, elapsed, allocs);
+}
+
+
+
+static void bench_reset(MINESWEEPER_FIELD *field, int size, double min_seconds) {
+    long ops = 0, before = allocations;
+    double start = bench_now(), elapsed = 0;
+
+    while (elapsed < min_seconds) {
+        minesweeper_field_reset(field, size / 2, size / 2, true);
+        ops++;
+        elapsed = bench_now() - start;
+    }
+    bench_report("reset", size, ops, (double)ops * size * size, elapsed, allocations - before);
+}
+
+
+
+/*
+ * Uncovers, one by one, every safe cell that doesn't cascade. Each call
+ * uncovers exactly one cell, so one board provides many operations.
+ */
+static void bench_uncover_single(MINESWEEPER_FIELD *field, int size, double min_seconds) {
+    long ops = 0, allocs = 0;
+    double elapsed = 0;
+
+    while (elapsed < min_seconds) {
+        minesweeper_field_reset(field, size / 2, size / 2, true);
+        long before = allocations;
+        double start = bench_now();
+        for (int row = 0; row < size; row++)
+            for (int col = 0; col < size; col++)
+                if (!minesweeper_cell_mine(field, row, col) && minesweeper_cell_hint(field, row, col) != 0) {
+                    minesweeper_event_uncover(field, row, col);
+                    ops++;
+                }
+        elapsed += bench_now() - start;
+        allocs += allocations - before;
+    }
+    bench_report("uncover_single", size, ops, ops, elapsed, allocs);
+}
+
+
+
+/*
+ * Uncovers a board with no mines from its center, so a single call cascades
+ * through every cell.
+ */
+static void bench_uncover_cascade(MINESWEEPER_FIELD *field, int size, double min_seconds) {
+    long ops = 0, allocs = 0;
+    double elapsed = 0, cells = 0;
+    float density = field->density;
+
+    field->density = 1e-12;
+    while (elapsed < min_seconds) {
+        minesweeper_field_resize(field, size, size);
+        long before = allocations;
+        double start = bench_now();
+        minesweeper_event_uncover(field, size / 2, size / 2);
+        elapsed += bench_now() - start;
+        allocs += allocations - before;
+        cells += (double)size * size - field->cell_count;
+        ops++;
+    }
+    field->density = density;
+    bench_report("uncover_cascade", size, ops, cells, elapsed, allocs);
+}
+
+
+
+/*
+ * Cycles every cell of the board through all three flag states.
+ */
+static void bench_flag(MINESWEEPER_FIELD *field, int size, double min_seconds) {
+    long ops = 0, before;
+    double start, elapsed = 0;
+
+    minesweeper_field_resize(field, size, size);
+    before = allocations;
+    start = bench_now();
+    while (elapsed < min_seconds) {
+        for (int row = 0; row < size; row++)
+            for (int col = 0; col < size; col++) {
+                minesweeper_event_flag(field, row, col);
+                minesweeper_event_flag(field, row, col);
+                minesweeper_event_flag(field, row, col);
+            }
+        ops += 3L * size * size;
+        elapsed = bench_now() - start;
+    }
+    bench_report("flag", size, ops, ops, elapsed, allocations - before);
+}
+
+
+
+/*
+ * Computes the difficulty metrics of a new board each time, so nothing 
+ * computed for an earlier board can be reused. Generating the boards is left 
+ * out of the timings.
+ */
+static void bench_metrics(MINESWEEPER_FIELD *field, int size, double min_seconds) {
+    MINESWEEPER_METRICS metrics;
+    long ops = 0, allocs = 0;
+    double elapsed = 0;
+
+    minesweeper_field_resize(field, size, size);
+    while (elapsed < min_seconds) {
+        minesweeper_field_generate(field, size / 2, size / 2, true);
+        long before = allocations;
+        double start = bench_now();
+        minesweeper_field_metrics(field, &metrics);
+        elapsed += bench_now() - start;
+        allocs += allocations - before;
+        ops++;
+    }
+    bench_report("metrics", size, ops, (double)ops * size * size, elapsed, allocs);
+}
+
+
+
+static void bench_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [max_size] [min_seconds]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+
+
+int main(int argc, char **argv) {
+    long max_size = 10000;
+    double min_seconds = 0.25;
+    char *end;
+
+    if (argc > 3)
+        bench_usage(argv[0]);
+    if (argc > 1) {
+        max_size = strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end != '\0' || max_size < sizes[0])
+            bench_usage(argv[0]);
+    }
+    if (argc > 2) {
+        min_seconds = strtod(argv[2], &end);
+        if (end == argv[2] || *end != '\0' || !(min_seconds > 0))
+            bench_usage(argv[0]);
+    }
+
+    printf("{\n  \"allocation_tracking\": %s,\n  \"results\": [",
+#ifdef BENCH_COUNT_ALLOCATIONS
+            "true"
+#else
+            "false"
+#endif
+            );
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && sizes[i] <= max_size; i++) {
+        int size = sizes[i];
+        bench_create(size, min_seconds);
+
+        MINESWEEPER_FIELD *field = minesweeper_field_create(size, size);
+        minesweeper_field_seed(field, size);
+        bench_reset(field, size, min_seconds);
+        bench_uncover_single(field, size, min_seconds);
+        bench_uncover_cascade(field, size, min_seconds);
+        bench_flag(field, size, min_seconds);
+        bench_metrics(field, size, min_seconds);
+        minesweeper_field_destroy(field);
+    }
+    printf("\n  ]\n}\n");
+
+    return 0;
+}
+
@@ -37,6 +37,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_ttf.h>
 #include <allegro5/allegro_font.h>
@@ -50,6 +52,8 @@
 #endif
 #include "game.h"
 #include "monstrominas.h"
+#include "solver.h"
+#include "analysis.h"
 // Embedded resources
 #include "resources_flag.h"
 #include "resources_mine.h"
@@ -63,14 +67,49 @@
 #define MAX_BACKGROUNDS      10
 #define MAX_ALPHA           320
 #define GAME_FPS              5
+#define NOGUESS_THREADS       4
+#define NOGUESS_SECONDS     5.0     // Time budget to find a no-guess layout, after which the game starts anyway
+#define NOGUESS_MAX_CELLS 1000000   // Bigger fields never use no-guess layouts, every racing thread needs a copy
+#define HINT_MAX_CELLS    1000000   // Bigger fields never show the safest cell, its analysis needs a probability per cell
+#define MAX_GAME_SIZE     10000
+#define BLUR_RADIUS          25     // Background blur radius, in pixels of the background image
+#define BLUR_PASSES           3
+#define FADE_FPS             30
+#define FADE_FRAMES          30
+#define BACKGROUND_EVENT_LOADED     ALLEGRO_GET_EVENT_TYPE('M', 'M', 'B', 'G')
+#define NOGUESS_EVENT_READY         ALLEGRO_GET_EVENT_TYPE('M', 'M', 'N', 'G')
+#define MAX_ZOOM              4
+#define ZOOM_STEP          1.25     // Zoom factor per mouse wheel step
+#define PAN_STEP             64     // Screen pixels per arrow key press
+#define LOD_CELL_PIXELS       6     // Below this cell size the LOD texture is drawn instead of the cells
+#define LOD_TILE           2048     // Cells per side of every LOD texture tile
+#define SAVE_FILE           "monstrominas.sav"  // Game in progress, in the user data directory
+#define SAVE_IDLE           1.0     // Seconds without moves before the game in progress is saved
+#define SAVE_INTERVAL      30.0     // Maximum seconds between snapshots while the player keeps moving
+#define SAVE_EVENT_WRITTEN          ALLEGRO_GET_EVENT_TYPE('M', 'M', 'S', 'V')
+
+// Atlas tiles, in order, hints 1 to 8 start at TILE_HINT
+enum {TILE_COVERED, TILE_REVEALED, TILE_HINT, TILE_FLAG = TILE_HINT + 8, TILE_WARNING, TILE_MINE, TILE_COUNT};
 
 
 
 // support.c function prototypes
 ALLEGRO_BITMAP *bmputils_transpose_blur(ALLEGRO_BITMAP *bmp, int radius);
 ALLEGRO_BITMAP *bmputils_box_blur(ALLEGRO_BITMAP *bmp, int radius);
+ALLEGRO_BITMAP *bmputils_fast_blur(ALLEGRO_BITMAP *bmp, int radius, int width, int height, int passes);
+void bmputils_set_threads(int count);
 // Forward declarations
 GAME_ACTOR *minesweeper_field_actor(int rows, int cols);
+void minesweeper_camera_fit(GAME_ACTOR *actor);
+void background_loaded(ALLEGRO_EVENT *event);
+void noguess_ready(ALLEGRO_EVENT *event);
+void log_console(const char *format, va_list args);
+void save_game(MINESWEEPER_FIELD *field, bool force);
+void save_game_later(void);
+void save_written(ALLEGRO_EVENT *event);
+void save_wait(void);
+void *noguess_generate(ALLEGRO_THREAD *thread, void *arg);
+void *save_write(ALLEGRO_THREAD *thread, void *arg);
 
 // Allegro global variables
 ALLEGRO_EVENT_QUEUE *events = NULL;
@@ -82,79 +121,451 @@ ALLEGRO_EVENT event;
 bool game_over = false;
 bool redraw = true;
 bool quit = false;
+bool no_guess = false;
 
 // Game global variables
-int max_rows = SCR_HEIGHT / 2 / MINESWEEPER_CELL_SIZE,          // Default vaules
-    max_cols = SCR_WIDTH / 2 / MINESWEEPER_CELL_SIZE;
 int game_rows = MINESWEEPER_ROWS, game_cols = MINESWEEPER_COLUMNS;
 int game_cell_size = MINESWEEPER_CELL_SIZE;
 int info_alpha = MAX_ALPHA;                                     // Crappy workaround
+int hint_row = -1, hint_col = -1;                               // Safest cell, shown until the next move
+double hint_probability = 0;
 GAME_ACTOR *game_actor = NULL;
-ALLEGRO_FILE *font_memfile = NULL;
 ALLEGRO_PATH *bg[MAX_BACKGROUNDS] = {0};
 ALLEGRO_BITMAP *background = NULL, *threshold = NULL, *warning = NULL, *mine = NULL, *flag = NULL;
+ALLEGRO_BITMAP *atlas = NULL;                                   // Prebaked cell tiles, see minesweeper_atlas_create()
+int atlas_cell_size = 0;
+float camera_x = 0, camera_y = 0;                               // Board pixel at the top left corner of the screen
+float zoom = 1;                                                 // Screen pixels per board pixel
+bool dragging = false;
+ALLEGRO_BITMAP *scene = NULL;                                   // Cached frame without the HUD, see minesweeper_scene_render()
+ALLEGRO_BITMAP *wall = NULL, *board_base = NULL;                // Screen sized backdrops, see minesweeper_backdrop_create()
+ALLEGRO_BITMAP *old_wall = NULL, *old_board_base = NULL;
+float fade = 1;                                                 // Fade in progress of the backdrops, from 0 to 1
+ALLEGRO_TIMER *fade_timer = NULL;
+ALLEGRO_THREAD *background_thread = NULL;
+ALLEGRO_EVENT_SOURCE background_source;                         // Emits the events of every background thread
+ALLEGRO_THREAD *noguess_thread = NULL;                          // Generating the first layout, see noguess_generate()
+int noguess_row = -1, noguess_col = -1;
+uint64_t noguess_seed = 0;
+ALLEGRO_BITMAP **lod = NULL;                                    // One pixel per cell tiles, see minesweeper_lod_create()
+int lod_rows = 0, lod_cols = 0;
+bool lod_valid = false;
+bool scene_valid = false;
+char *save_path = NULL;                                         // Snapshot of the game in progress, see save_game()
+bool save_pending = false;
+double save_time = 0, move_time = 0;
+uint8_t *save_buffer = NULL;                                    // Snapshot being written by save_write(), reused
+size_t save_capacity = 0, save_size = 0;
+ALLEGRO_THREAD *save_thread = NULL;
+MINESWEEPER_CHANGES *changes = NULL;                            // Cells changed since the scene was last updated
+ALLEGRO_VERTEX *vertices = NULL;
+int vertex_capacity = 0;
 
 
 
-void minesweeper_field_draw(GAME_ACTOR *actor) {
-    MINESWEEPER_FIELD *field = actor->data;
-    ALLEGRO_COLOR color = al_color_name("lightgray");
+/*
+ * Renders every cell tile once, side by side in a single bitmap, at the given
+ * cell size. The field is then drawn by copying tiles, with no text layout or
+ * bitmap scaling at draw time. Tiles are filtered linearly so that they can be
+ * scaled when zooming.
+ */
+void minesweeper_atlas_create(int cell_size) {
+    ALLEGRO_BITMAP *target = al_get_target_bitmap();
     ALLEGRO_COLOR black = al_color_name("black");
     ALLEGRO_COLOR white = al_color_name("white");
-    int alpha = info_alpha - 100 < 0 ? 0 : info_alpha - 100;
-    ALLEGRO_COLOR transparency = al_map_rgba(0, 0, 0, alpha);
-    ALLEGRO_COLOR hint = al_map_rgba(alpha, alpha, 160 * alpha / 255, alpha);
+    ALLEGRO_COLOR grid = al_map_rgba(64, 64, 64, 128);
+    ALLEGRO_BITMAP *icons[] = {flag, warning, mine};
     int font_height = al_get_font_line_height(font);
+    int flags = al_get_new_bitmap_flags();
 
-    for (int row = 0; row < field->rows; row++)
-        for (int col = 0; col < field->cols; col++) {
-            int x1 = actor->x + col * field->cell_size, y1 = actor->y + row * field->cell_size;
-            int x2 = x1 + field->cell_size, y2 = y1 + field->cell_size;
-            if (!((bool (*)[field->cols])field->state)[row][col]) {
-                al_draw_filled_rectangle(x1, y1, x2, y2, al_color_name("darkgray"));
-                al_draw_rectangle(x1, y1, x2 - 1, y2 - 1, black, 1);
-                al_draw_line(x1, y1, x2, y1, white, 1);
-                al_draw_line(x1, y1, x1, y2, white, 1);
-            }
-            else {
-                al_draw_rectangle(x1, y1, x2, y2, al_map_rgba(64, 64, 64, 128), 1);
+    if (atlas)
+        al_destroy_bitmap(atlas);
+    al_set_new_bitmap_flags(flags | ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR);
+    atlas = al_create_bitmap(cell_size * TILE_COUNT, cell_size);
+    al_set_new_bitmap_flags(flags);
+    assert(atlas);
+    al_set_target_bitmap(atlas);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    for (int tile = 0; tile < TILE_COUNT; tile++) {
+        float x1 = tile * cell_size, x2 = x1 + cell_size;
+        al_set_clipping_rectangle(x1, 0, cell_size, cell_size);
+        if (tile == TILE_COVERED) {
+            al_draw_filled_rectangle(x1, 0, x2, cell_size, al_color_name("darkgray"));
+            al_draw_rectangle(x1 + .5, .5, x2 - .5, cell_size - .5, black, 1);
+            al_draw_line(x1, .5, x2, .5, white, 1);
+            al_draw_line(x1 + .5, 0, x1 + .5, cell_size, white, 1);
+        }
+        else if (tile < TILE_FLAG) {
+            al_draw_rectangle(x1 + .5, .5, x2 - .5, cell_size - .5, grid, 1);
+            if (tile >= TILE_HINT)
+                al_draw_textf(font, black, x1 + cell_size / 2, cell_size - font_height, ALLEGRO_ALIGN_CENTER, "%d", tile - TILE_HINT + 1);
+        }
+        else {
+            ALLEGRO_BITMAP *icon = icons[tile - TILE_FLAG];
+            al_draw_scaled_bitmap(icon, 0, 0, al_get_bitmap_width(icon), al_get_bitmap_height(icon), x1, 0, cell_size, cell_size, 0);
+        }
+    }
+    al_reset_clipping_rectangle();
+    al_set_target_bitmap(target);
+    atlas_cell_size = cell_size;
+}
+
+
+
+/*
+ * Appends an atlas tile, as two textured triangles, to a vertex array. Texture
+ * coordinates stay half a texel inside the tile so that neighboring tiles
+ * don't bleed in when the tile is scaled.
+ */
+static ALLEGRO_VERTEX *push_tile(ALLEGRO_VERTEX *v, float x1, float y1, float x2, float y2, int size, int tile) {
+    ALLEGRO_COLOR white = al_map_rgb(255, 255, 255);
+    float u1 = tile * size + .5, u2 = (tile + 1) * size - .5, v1 = .5, v2 = size - .5;
+    ALLEGRO_VERTEX corners[4] = {
+        {x1, y1, 0, u1, v1, white}, {x2, y1, 0, u2, v1, white},
+        {x2, y2, 0, u2, v2, white}, {x1, y2, 0, u1, v2, white}
+    };
+
+    v[0] = corners[0], v[1] = corners[1], v[2] = corners[2];
+    v[3] = corners[0], v[4] = corners[2], v[5] = corners[3];
+    return v + 6;
+}
+
+
+
+static ALLEGRO_VERTEX *reserve_vertices(int count) {
+    if (count > vertex_capacity) {
+        vertices = realloc(vertices, count * sizeof(ALLEGRO_VERTEX));
+        assert(vertices);
+        vertex_capacity = count;
+    }
+    return vertices;
+}
+
+
+
+static inline int clampi(int x, int a, int b) {
+    return x < a ? a : (x > b ? b : x);
+}
+
+
+
+/*
+ * Screen coordinates of the top left corner of a cell. Cell edges are rounded
+ * to whole pixels so that neighboring cells never overlap or leave gaps.
+ */
+static float screen_x(MINESWEEPER_FIELD *field, int col) {
+    return floorf((col * field->cell_size - camera_x) * zoom + .5);
+}
+
+static float screen_y(MINESWEEPER_FIELD *field, int row) {
+    return floorf((row * field->cell_size - camera_y) * zoom + .5);
+}
+
+
+
+/*
+ * Appends the tiles of a cell to a vertex array: at most three per cell, the
+ * cell itself, its flag and, when the game is lost, its mine.
+ */
+static ALLEGRO_VERTEX *push_cell(ALLEGRO_VERTEX *v, MINESWEEPER_FIELD *field, int row, int col) {
+    float x1 = screen_x(field, col), y1 = screen_y(field, row);
+    float x2 = screen_x(field, col + 1), y2 = screen_y(field, row + 1);
+    int size = field->cell_size;
+    int hint_value = minesweeper_cell_hint(field, row, col);
+    int flag_value = minesweeper_cell_flag(field, row, col);
+
+    if (!minesweeper_cell_uncovered(field, row, col))
+        v = push_tile(v, x1, y1, x2, y2, size, TILE_COVERED);
+    else
+        v = push_tile(v, x1, y1, x2, y2, size, hint_value != 0 ? TILE_HINT + hint_value - 1 : TILE_REVEALED);
+
+    if (flag_value == MINESWEEPER_WARNING)
+        v = push_tile(v, x1, y1, x2, y2, size, TILE_WARNING);
+    else if (flag_value == MINESWEEPER_DANGER)
+        v = push_tile(v, x1, y1, x2, y2, size, TILE_FLAG);
+    if (game_over && !field->complete && minesweeper_cell_mine(field, row, col))
+        v = push_tile(v, x1, y1, x2, y2, size, TILE_MINE);
+    return v;
+}
+
+
+
+/*
+ * Finds the rows and columns that intersect the screen, as half open ranges.
+ */
+static void visible_cells(MINESWEEPER_FIELD *field, int *row1, int *col1, int *row2, int *col2) {
+    float size = field->cell_size;
+
+    *col1 = floorf(camera_x / size);
+    *row1 = floorf(camera_y / size);
+    *col2 = ceilf((camera_x + SCR_WIDTH / zoom) / size);
+    *row2 = ceilf((camera_y + SCR_HEIGHT / zoom) / size);
+    *col1 = clampi(*col1, 0, field->cols);
+    *row1 = clampi(*row1, 0, field->rows);
+    *col2 = clampi(*col2, 0, field->cols);
+    *row2 = clampi(*row2, 0, field->rows);
+}
+
+
+
+/*
+ * Writes the level of detail colors, one pixel per cell, of a rectangle of
+ * cells into the LOD tiles. Rows and columns are half open ranges.
+ */
+void minesweeper_lod_update(MINESWEEPER_FIELD *field, int row1, int col1, int row2, int col2) {
+    for (int tile_row = row1 / LOD_TILE; tile_row * LOD_TILE < row2; tile_row++)
+        for (int tile_col = col1 / LOD_TILE; tile_col * LOD_TILE < col2; tile_col++) {
+            ALLEGRO_BITMAP *tile = lod[tile_row * lod_cols + tile_col];
+            int top = tile_row * LOD_TILE, left = tile_col * LOD_TILE;
+            int y1 = row1 > top ? row1 : top, y2 = row2 < top + LOD_TILE ? row2 : top + LOD_TILE;
+            int x1 = col1 > left ? col1 : left, x2 = col2 < left + LOD_TILE ? col2 : left + LOD_TILE;
+            ALLEGRO_LOCKED_REGION *region = al_lock_bitmap_region(tile, x1 - left, y1 - top, x2 - x1, y2 - y1, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+            assert(region);
+            for (int row = y1; row < y2; row++) {
+                uint8_t *pixel = (uint8_t *)region->data + (row - y1) * region->pitch;
+                for (int col = x1; col < x2; col++, pixel += 4) {
+                    int flag_value = minesweeper_cell_flag(field, row, col);
+                    uint8_t shade = 169;
+                    if (game_over && !field->complete && minesweeper_cell_mine(field, row, col))
+                        shade = 0;
+                    else if (minesweeper_cell_uncovered(field, row, col))
+                        shade = 250 - minesweeper_cell_hint(field, row, col) * 16;
+                    pixel[0] = flag_value == MINESWEEPER_DANGER ? 220 : (flag_value == MINESWEEPER_WARNING ? 240 : shade);
+                    pixel[1] = flag_value == MINESWEEPER_DANGER ? 0 : (flag_value == MINESWEEPER_WARNING ? 200 : shade);
+                    pixel[2] = flag_value != 0 ? 0 : shade;
+                    pixel[3] = 255;
+                }
             }
+            al_unlock_bitmap(tile);
+        }
+}
+
+
+
+/*
+ * Builds the level of detail texture used when cells get smaller than
+ * LOD_CELL_PIXELS, split in tiles of up to LOD_TILE cells per side.
+ */
+void minesweeper_lod_create(MINESWEEPER_FIELD *field) {
+    for (int i = 0; i < lod_rows * lod_cols; i++)
+        al_destroy_bitmap(lod[i]);
+    lod_rows = (field->rows + LOD_TILE - 1) / LOD_TILE;
+    lod_cols = (field->cols + LOD_TILE - 1) / LOD_TILE;
+    lod = realloc(lod, lod_rows * lod_cols * sizeof(ALLEGRO_BITMAP *));
+    assert(lod);
+    for (int tile_row = 0; tile_row < lod_rows; tile_row++)
+        for (int tile_col = 0; tile_col < lod_cols; tile_col++) {
+            int h = field->rows - tile_row * LOD_TILE, w = field->cols - tile_col * LOD_TILE;
+            lod[tile_row * lod_cols + tile_col] = al_create_bitmap(w < LOD_TILE ? w : LOD_TILE, h < LOD_TILE ? h : LOD_TILE);
+            assert(lod[tile_row * lod_cols + tile_col]);
+        }
+    minesweeper_lod_update(field, 0, 0, field->rows, field->cols);
+    lod_valid = true;
+}
+
+
+
+/*
+ * Builds the two screen sized backdrops from the current background images:
+ * the wall behind the board, from the blurred image, and the board background
+ * itself. The previous backdrops, if any, are kept to fade from.
+ */
+void minesweeper_backdrop_create() {
+    ALLEGRO_BITMAP *target = al_get_target_bitmap();
+    int w = al_get_bitmap_width(background),
+        h = al_get_bitmap_height(background);
+    float scalex = SCR_WIDTH * 1.0 / w,
+          scaley = SCR_HEIGHT * 1.0 / h;
+
+    if (old_wall) {
+        al_destroy_bitmap(old_wall);
+        al_destroy_bitmap(old_board_base);
+    }
+    old_wall = wall;
+    old_board_base = board_base;
+    wall = al_create_bitmap(SCR_WIDTH, SCR_HEIGHT);
+    board_base = al_create_bitmap(SCR_WIDTH, SCR_HEIGHT);
+    assert(wall && board_base);
+
+    al_set_target_bitmap(wall);
+    al_clear_to_color(al_map_rgb(255, 255, 255));
+// The blurred image is smaller than the background, see bmputils_fast_blur()
+    al_draw_tinted_scaled_bitmap(threshold, al_map_rgba(192, 192, 192, 192), 0, 0, al_get_bitmap_width(threshold), al_get_bitmap_height(threshold), 0, 0, SCR_WIDTH, SCR_HEIGHT, 0);
+    al_set_target_bitmap(board_base);
+    al_clear_to_color(al_map_rgb(255, 255, 255));
+    al_draw_tinted_scaled_rotated_bitmap_region(background, 0, 0, w, h, al_map_rgba(128, 128, 128, 128), 0, 0, 0, 0, scalex, scaley, 0, 0);
+    al_set_target_bitmap(target);
+    fade = old_wall ? 0 : 1;
+    scene_valid = false;
+}
+
 
-            if (((int (*)[field->cols])field->hints)[row][col] != 0 && ((bool (*)[field->cols])field->state)[row][col])
-                al_draw_textf(font, black, x1 + field->cell_size / 2, y1 + (field->cell_size - font_height), ALLEGRO_ALIGN_CENTER, "%d", ((int (*)[field->cols])field->hints)[row][col]);
 
-            if (((int (*)[field->cols])field->flags)[row][col] != 0) {
-                if (((int (*)[field->cols])field->flags)[row][col] == MINESWEEPER_WARNING)
-                    al_draw_scaled_bitmap(warning, 0, 0, al_get_bitmap_width(warning), al_get_bitmap_height(warning), x1, y1, field->cell_size , field->cell_size, 0);
-                else if (((int (*)[field->cols])field->flags)[row][col] == MINESWEEPER_DANGER)
-                    al_draw_scaled_bitmap(flag, 0, 0, al_get_bitmap_width(flag), al_get_bitmap_height(flag), x1, y1, field->cell_size, field->cell_size, 0);
+/*
+ * Copies a region of a backdrop to the same place on the target bitmap,
+ * blended over the previous backdrop while fading in.
+ */
+static void draw_backdrop(ALLEGRO_BITMAP *backdrop, ALLEGRO_BITMAP *old, int x, int y, int w, int h) {
+    if (old && fade < 1) {
+        al_draw_bitmap_region(old, x, y, w, h, x, y, 0);
+        al_draw_tinted_bitmap_region(backdrop, al_map_rgba_f(fade, fade, fade, fade), x, y, w, h, x, y, 0);
+    }
+    else
+        al_draw_bitmap_region(backdrop, x, y, w, h, x, y, 0);
+}
+
+
+
+/*
+ * Renders the whole frame except for the HUD into the cached scene bitmap:
+ * the blurred background, the board background and the visible cells.
+ */
+void minesweeper_scene_render(GAME_ACTOR *actor) {
+    MINESWEEPER_FIELD *field = actor->data;
+    ALLEGRO_BITMAP *target = al_get_target_bitmap();
+
+    if (!scene) {
+        scene = al_create_bitmap(SCR_WIDTH, SCR_HEIGHT);
+        assert(scene);
+    }
+
+    al_set_target_bitmap(scene);
+    draw_backdrop(wall, old_wall, 0, 0, SCR_WIDTH, SCR_HEIGHT);
+    int x1 = clampi(screen_x(field, 0), 0, SCR_WIDTH), x2 = clampi(screen_x(field, field->cols), 0, SCR_WIDTH);
+    int y1 = clampi(screen_y(field, 0), 0, SCR_HEIGHT), y2 = clampi(screen_y(field, field->rows), 0, SCR_HEIGHT);
+    if (x2 > x1 && y2 > y1)
+        draw_backdrop(board_base, old_board_base, x1, y1, x2 - x1, y2 - y1);
+
+    if (field->cell_size * zoom < LOD_CELL_PIXELS) {
+        if (!lod_valid)
+            minesweeper_lod_create(field);
+        for (int tile_row = 0; tile_row < lod_rows; tile_row++)
+            for (int tile_col = 0; tile_col < lod_cols; tile_col++) {
+                ALLEGRO_BITMAP *tile = lod[tile_row * lod_cols + tile_col];
+                int row = tile_row * LOD_TILE, col = tile_col * LOD_TILE;
+                float tx1 = screen_x(field, col), ty1 = screen_y(field, row);
+                float tx2 = screen_x(field, col + al_get_bitmap_width(tile)), ty2 = screen_y(field, row + al_get_bitmap_height(tile));
+                if (tx2 <= 0 || ty2 <= 0 || tx1 >= SCR_WIDTH || ty1 >= SCR_HEIGHT) continue;
+                al_draw_scaled_bitmap(tile, 0, 0, al_get_bitmap_width(tile), al_get_bitmap_height(tile), tx1, ty1, tx2 - tx1, ty2 - ty1, 0);
             }
+    }
+    else {
+        int row1, col1, row2, col2;
+        visible_cells(field, &row1, &col1, &row2, &col2);
+        ALLEGRO_VERTEX *v = reserve_vertices((row2 - row1) * (col2 - col1) * 3 * 6);
+        for (int row = row1; row < row2; row++)
+            for (int col = col1; col < col2; col++)
+                v = push_cell(v, field, row, col);
+        al_draw_prim(vertices, NULL, atlas, 0, v - vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+    }
+
+    al_set_target_bitmap(target);
+    scene_valid = true;
+    minesweeper_changes_clear(changes);
+}
+
+
+
+/*
+ * Brings the cached scene and the LOD texture up to date with the cells
+ * changed since the last frame. Changes are compacted into runs of consecutive
+ * cells so that a large cascade costs one background blit per visible row it
+ * touches; cells outside the screen only update the LOD texture.
+ */
+void minesweeper_scene_update(GAME_ACTOR *actor) {
+    MINESWEEPER_FIELD *field = actor->data;
+    ALLEGRO_BITMAP *target = al_get_target_bitmap();
+    int row1, col1, row2, col2;
+
+    minesweeper_changes_compact(changes);
+    if (lod_valid) {
+        int left = field->cols, right = 0;
+        for (int i = 0; i < changes->count; i++) {
+            int col = changes->cells[i] % field->cols;
+            left = col < left ? col : left;
+            right = col + 1 > right ? col + 1 : right;
         }
+        minesweeper_lod_update(field, changes->cells[0] / field->cols, left, changes->cells[changes->count - 1] / field->cols + 1, right);
+    }
+    if (field->cell_size * zoom < LOD_CELL_PIXELS) {
+        minesweeper_scene_render(actor);
+        return;
+    }
 
-    if (game_over) {
-        float x = game_cols / 2. * game_cell_size;
-        float y = game_rows / 2. * game_cell_size;
-        if (!field->complete) {
-            for (int row = 0; row < field->rows; row++)
-                for (int col = 0; col < field->cols; col++) {
-                    int x1 = actor->x + col * field->cell_size, y1 = actor->y + row * field->cell_size;
-
-                    if (((bool (*)[field->cols])field->cells)[row][col])
-                        al_draw_scaled_bitmap(mine, 0, 0, al_get_bitmap_width(mine), al_get_bitmap_height(mine), x1, y1, field->cell_size, field->cell_size, 0);
-                }
+    visible_cells(field, &row1, &col1, &row2, &col2);
+    al_set_target_bitmap(scene);
+    ALLEGRO_VERTEX *v = reserve_vertices(changes->count * 3 * 6);
+    for (int i = 0; i < changes->run_count; i++) {
+        int cell = changes->runs[2 * i], end = cell + changes->runs[2 * i + 1];
+        while (cell < end) {
+            int row = cell / field->cols, col = cell % field->cols;
+            int length = end - cell < field->cols - col ? end - cell : field->cols - col;
+            int first = col > col1 ? col : col1, last = col + length < col2 ? col + length : col2;
+            cell += length;
+            if (row < row1 || row >= row2 || first >= last) continue;
+
+            int x1 = clampi(screen_x(field, first), 0, SCR_WIDTH), x2 = clampi(screen_x(field, last), 0, SCR_WIDTH);
+            int y1 = clampi(screen_y(field, row), 0, SCR_HEIGHT), y2 = clampi(screen_y(field, row + 1), 0, SCR_HEIGHT);
+            if (x2 > x1 && y2 > y1)
+                draw_backdrop(board_base, old_board_base, x1, y1, x2 - x1, y2 - y1);
+            for (int j = first; j < last; j++)
+                v = push_cell(v, field, row, j);
         }
+    }
+    al_draw_prim(vertices, NULL, atlas, 0, v - vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+    al_set_target_bitmap(target);
+    minesweeper_changes_clear(changes);
+}
+
+
+
+/*
+ * Draws the cached scene, bringing it up to date first, and then the HUD on
+ * top of it. Only the HUD and the changed cells cost anything per frame.
+ */
+void minesweeper_field_draw(GAME_ACTOR *actor) {
+    MINESWEEPER_FIELD *field = actor->data;
+    int alpha = info_alpha - 100 < 0 ? 0 : info_alpha - 100;
+    ALLEGRO_COLOR black = al_map_rgb(0, 0, 0);
+    ALLEGRO_COLOR transparency = al_map_rgba(0, 0, 0, alpha);
+    ALLEGRO_COLOR hint = al_map_rgba(alpha, alpha, 160 * alpha / 255, alpha);
+    int font_height = al_get_font_line_height(font);
+
+    if (!atlas || atlas_cell_size != field->cell_size) {
+        minesweeper_atlas_create(field->cell_size);
+        scene_valid = false;
+    }
+    if (!scene_valid)
+        minesweeper_scene_render(actor);
+    else if (changes->count > 0)
+        minesweeper_scene_update(actor);
+    al_draw_bitmap(scene, 0, 0, 0);
+
+    if (hint_row >= 0 && !game_over) {
+        float x1 = screen_x(field, hint_col), y1 = screen_y(field, hint_row);
+        float x2 = screen_x(field, hint_col + 1), y2 = screen_y(field, hint_row + 1);
+        al_draw_rectangle(x1 + 1, y1 + 1, x2 - 1, y2 - 1, al_map_rgb(0, 160, 0), 2);
+    }
+
+    if (game_over) {
+        float x = game_cols / 2. * field->cell_size * zoom;
+        float y = game_rows / 2. * field->cell_size * zoom;
         al_draw_rectangle(SCR_WIDTH / 2 - x, SCR_HEIGHT / 2 - y, SCR_WIDTH / 2 + x, SCR_HEIGHT / 2 + y, al_map_rgb(255, 0, 0), 3);
 
-        al_draw_filled_rectangle(10, 10, SCR_WIDTH - 10, font_height * 3 + 20, hint);
-        al_draw_rectangle(10, 10, SCR_WIDTH - 10, font_height * 3 + 20, transparency, 2);
+        al_draw_filled_rectangle(10, 10, SCR_WIDTH - 10, font_height * 4 + 20, hint);
+        al_draw_rectangle(10, 10, SCR_WIDTH - 10, font_height * 4 + 20, transparency, 2);
         al_draw_multiline_textf(font, transparency, SCR_WIDTH / 2, 15, SCR_WIDTH, font_height, ALLEGRO_ALIGN_CENTER, "Use the mouse WHEEL to change the minefield size.\n"
                 "Click the LEFT mouse button to start a new game. Press ESCAPE to quit.\n"
-                "New size: %dx%d", game_cols, game_rows);
+                "Press N to toggle minefields that never need a guess (%s).\n"
+                "New size: %dx%d", no_guess ? (game_rows * game_cols <= NOGUESS_MAX_CELLS ? "on" : "off for this size") : "off", game_cols, game_rows);
     }
     else {
-        al_draw_filled_rectangle(10, 10, SCR_WIDTH - 10, font_height * 2 + 20, hint);
-        al_draw_rectangle(10, 10, SCR_WIDTH - 10, font_height * 2 + 20, transparency, 2);
-        al_draw_multiline_textf(font, transparency, SCR_WIDTH / 2, 15, SCR_WIDTH, font_height, ALLEGRO_ALIGN_CENTER, "Mines: %d\nTime: %d", field->mine_count - field->flags_count, al_get_timer_count(timer) / GAME_FPS);
+        al_draw_filled_rectangle(10, 10, SCR_WIDTH - 10, font_height * 3 + 20, hint);
+        al_draw_rectangle(10, 10, SCR_WIDTH - 10, font_height * 3 + 20, transparency, 2);
+        al_draw_multiline_textf(font, transparency, SCR_WIDTH / 2, 15, SCR_WIDTH, font_height, ALLEGRO_ALIGN_CENTER, "Mines: %d\nTime: %d\n%s", field->mine_count - field->flags_count, al_get_timer_count(timer) / GAME_FPS,
+                noguess_thread ? "Generating a minefield that never needs a guess..." : (hint_row >= 0 ? "" : (field->rows * field->cols <= HINT_MAX_CELLS ? "Press H to show the safest cell." : "")));
+        if (hint_row >= 0)
+            al_draw_textf(font, transparency, SCR_WIDTH / 2, 15 + font_height * 2, ALLEGRO_ALIGN_CENTER, "Safest cell: %.1f%% chance of a mine", hint_probability * 100);
     }
 
     if (field->complete)
@@ -163,65 +574,176 @@ void minesweeper_field_draw(GAME_ACTOR *actor) {
 
 
 
+/*
+ * Keeps the zoom between half the size that fits the whole board and
+ * MAX_ZOOM, and the center of the board on the screen.
+ */
+void minesweeper_camera_clamp(GAME_ACTOR *actor) {
+    MINESWEEPER_FIELD *field = actor->data;
+    float w = field->cols * field->cell_size, h = field->rows * field->cell_size;
+    float fit = SCR_WIDTH / w < SCR_HEIGHT / h ? SCR_WIDTH / w : SCR_HEIGHT / h;
+    float min_zoom = fit / 2 < 1 ? fit / 2 : 1;
+
+    zoom = zoom < min_zoom ? min_zoom : (zoom > MAX_ZOOM ? MAX_ZOOM : zoom);
+    camera_x = camera_x < w / 2 - SCR_WIDTH / zoom ? w / 2 - SCR_WIDTH / zoom : (camera_x > w / 2 ? w / 2 : camera_x);
+    camera_y = camera_y < h / 2 - SCR_HEIGHT / zoom ? h / 2 - SCR_HEIGHT / zoom : (camera_y > h / 2 ? h / 2 : camera_y);
+    actor->x = screen_x(field, 0);
+    actor->y = screen_y(field, 0);
+    scene_valid = false;
+    redraw = true;
+}
+
+
+
+/*
+ * Zooms by \c factor keeping the board point under the given screen
+ * coordinates in place.
+ */
+void minesweeper_camera_zoom(GAME_ACTOR *actor, float factor, float x, float y) {
+    float board_x = camera_x + x / zoom, board_y = camera_y + y / zoom;
+
+    zoom *= factor;
+    minesweeper_camera_clamp(actor);
+    camera_x = board_x - x / zoom;
+    camera_y = board_y - y / zoom;
+    minesweeper_camera_clamp(actor);
+}
+
+
+
+/*
+ * Camera controls, available both while playing and after the game is over:
+ * arrow keys and middle button drag pan, Home fits the board on the screen.
+ */
+void minesweeper_camera_logic(GAME_ACTOR *actor, ALLEGRO_EVENT *event) {
+    if (event->type == ALLEGRO_EVENT_KEY_CHAR) {
+        int keycode = event->keyboard.keycode;
+        if (keycode == ALLEGRO_KEY_LEFT || keycode == ALLEGRO_KEY_RIGHT || keycode == ALLEGRO_KEY_UP || keycode == ALLEGRO_KEY_DOWN) {
+            camera_x += ((keycode == ALLEGRO_KEY_RIGHT) - (keycode == ALLEGRO_KEY_LEFT)) * PAN_STEP / zoom;
+            camera_y += ((keycode == ALLEGRO_KEY_DOWN) - (keycode == ALLEGRO_KEY_UP)) * PAN_STEP / zoom;
+            minesweeper_camera_clamp(actor);
+        }
+        else if (keycode == ALLEGRO_KEY_HOME)
+            minesweeper_camera_fit(actor);
+    }
+    else if (event->type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN && event->mouse.button == 3)
+        dragging = true;
+    else if (event->type == ALLEGRO_EVENT_MOUSE_BUTTON_UP && event->mouse.button == 3)
+        dragging = false;
+    else if (event->type == ALLEGRO_EVENT_MOUSE_AXES && dragging && (event->mouse.dx != 0 || event->mouse.dy != 0)) {
+        camera_x -= event->mouse.dx / zoom;
+        camera_y -= event->mouse.dy / zoom;
+        minesweeper_camera_clamp(actor);
+    }
+}
+
+
+
+/*
+ * Uncovers a cell after the player clicks it, which ends the game if it's a 
+ * mine or the last safe cell.
+ */
+void uncover_cell(MINESWEEPER_FIELD *field, int row, int col) {
+    game_over = !minesweeper_event_uncover(field, row, col) || field->complete;
+    if (game_over && !field->complete)
+        scene_valid = lod_valid = false;    // Every mine is shown, redraw the whole board
+    hint_row = hint_col = -1;
+    save_game_later();
+    redraw = true;
+}
+
+
+
+/*
+ * Starts looking for a layout that never needs a guess from the first move at 
+ * (row, col). The search runs on its own thread, on a private field seeded 
+ * from the game field, and the move is played when noguess_ready() gets the 
+ * layout.
+ */
+void noguess_start(MINESWEEPER_FIELD *field, int row, int col) {
+    noguess_row = row;
+    noguess_col = col;
+    noguess_seed = field->rng.next(&field->rng);
+    noguess_thread = al_create_thread(noguess_generate, field);
+    assert(noguess_thread);
+    al_start_thread(noguess_thread);
+}
+
+
+
 void minesweeper_field_logic(GAME_ACTOR *actor, ALLEGRO_EVENT *event) {
     MINESWEEPER_FIELD *field = actor->data;
 
+    minesweeper_camera_logic(actor, event);
     if (!game_over) {
         if (event->any.source == al_get_mouse_event_source()) {
-            int row = (event->mouse.y - actor->y) / field->cell_size;
-            int col = (event->mouse.x - actor->x) / field->cell_size;
-            if (event->type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN && event->mouse.button == 1) {
-                if (field->move_count == 0)
-                    minesweeper_field_reset(field, row, col, false);
-                game_over = !minesweeper_event_uncover(field, row, col) || field->complete;
+            int row = floorf((event->mouse.y / zoom + camera_y) / field->cell_size);
+            int col = floorf((event->mouse.x / zoom + camera_x) / field->cell_size);
+        // Clicks outside the board, or while the first layout is generated, are ignored
+            bool playable = !noguess_thread && row >= 0 && row < field->rows && col >= 0 && col < field->cols;
+            if (event->type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN && event->mouse.button == 1 && playable) {
+                if (field->move_count == 0 && no_guess && field->rows * field->cols <= NOGUESS_MAX_CELLS)
+                    noguess_start(field, row, col);
+                else {
+                    if (field->move_count == 0)
+                        minesweeper_field_reset(field, row, col, false);
+                    uncover_cell(field, row, col);
+                }
                 redraw = true;
             }
-            else if (event->type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN && event->mouse.button == 2) {
+            else if (event->type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN && event->mouse.button == 2 && playable) {
                 minesweeper_event_flag(field, row, col);
+                save_game_later();
                 redraw = true;
             }
+            else if (event->type == ALLEGRO_EVENT_MOUSE_AXES && event->mouse.dz != 0)
+                minesweeper_camera_zoom(actor, powf(ZOOM_STEP, event->mouse.dz), event->mouse.x, event->mouse.y);
 
             info_alpha = event->mouse.y < MAX_ALPHA ? event->mouse.y : MAX_ALPHA;
         }
+        else if (event->any.source == al_get_keyboard_event_source()) {
+            if (event->type == ALLEGRO_EVENT_KEY_UP && event->keyboard.keycode == ALLEGRO_KEY_H && field->move_count > 0 &&
+                    field->rows * field->cols <= HINT_MAX_CELLS) {
+            // Point at the covered cell least likely to hold a mine, if there's memory for it
+                double *probabilities = malloc((size_t)field->rows * field->cols * sizeof(double));
+                if (probabilities) {
+                    minesweeper_field_probabilities(field, probabilities, MINESWEEPER_ANALYSIS_BUDGET);
+                    if (minesweeper_field_safest(field, probabilities, &hint_row, &hint_col))
+                        hint_probability = probabilities[hint_row * field->cols + hint_col];
+                    free(probabilities);
+                    redraw = true;
+                }
+            }
+        }
     }
     else {
         if (event->any.source == al_get_keyboard_event_source()) {
             if (event->type == ALLEGRO_EVENT_KEY_UP) {
                 if (event->keyboard.keycode == ALLEGRO_KEY_ESCAPE)
                     quit = true;
+                else if (event->keyboard.keycode == ALLEGRO_KEY_N) {
+                    no_guess = !no_guess;
+                    redraw = true;
+                }
             }
         }
         else if (event->any.source == al_get_mouse_event_source()) {
             if (event->type == ALLEGRO_EVENT_MOUSE_AXES && event->mouse.dz != 0) {
-                game_cols += event->mouse.dz;
-                game_rows += event->mouse.dz;
-                game_cols = game_cols < MINESWEEPER_COLUMNS ? MINESWEEPER_COLUMNS : game_cols;
-                game_rows = game_rows < MINESWEEPER_ROWS ? MINESWEEPER_ROWS : game_rows;
-                if (event->mouse.dz > 0 && game_cols > max_cols && game_rows > max_rows) {
-                    if (game_cols * game_cell_size > SCR_WIDTH || game_rows * game_cell_size > SCR_HEIGHT)
-                        game_cell_size -= game_cell_size > 12 ? 4 : 0;
-                }
-                else {
-                    int t = game_cell_size + 4;     // Candidate size
-                    if (event->mouse.dz < 0 && (game_cols * t < SCR_WIDTH) && (game_rows * t < SCR_HEIGHT))
-                        game_cell_size = game_cell_size < MINESWEEPER_CELL_SIZE ? t : MINESWEEPER_CELL_SIZE;
-                }
-                max_cols = SCR_WIDTH / game_cell_size;
-                max_rows = SCR_HEIGHT / game_cell_size;
-                game_cols = game_cols > max_cols ? max_cols : game_cols;
-                game_rows = game_rows > max_rows ? max_rows : game_rows;
-                printf("New field size: %dx%d, cell size: %d\n", game_cols, game_rows, game_cell_size);
+            // Bigger steps for bigger fields
+                int step = game_cols > game_rows ? game_cols / 10 : game_rows / 10;
+                step = step < 1 ? 1 : step;
+                game_cols = clampi(game_cols + event->mouse.dz * step, MINESWEEPER_COLUMNS, MAX_GAME_SIZE);
+                game_rows = clampi(game_rows + event->mouse.dz * step, MINESWEEPER_ROWS, MAX_GAME_SIZE);
+                printf("New field size: %dx%d\n", game_cols, game_rows);
                 redraw = true;
             }
             else if (event->type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN && event->mouse.button == 1) {
             // Reset game actor with a new minesweeper field
-                al_destroy_font(font);
-                font_memfile = al_open_memfile(ZillaSlab_Bold_ttf, ZillaSlab_Bold_ttf_len, "r");
-                font = al_load_ttf_font_f(font_memfile, NULL, game_cell_size, 0);
-                game_actor_destroy(game_actor);
-                game_actor = minesweeper_field_actor(game_rows, game_cols);
+                minesweeper_field_resize(field, game_rows, game_cols);
+                minesweeper_camera_fit(actor);
                 al_set_timer_count(timer, 0);
                 game_over = false;
+                lod_valid = false;
                 redraw = true;
             }
         }
@@ -237,22 +759,152 @@ GAME_ACTOR *minesweeper_field_actor(int rows, int cols) {
     MINESWEEPER_FIELD *field = minesweeper_field_create(rows, cols);
 
     actor->data = field;
+    changes = minesweeper_changes_create();
+    field->changes = changes;
     actor->print = minesweeper_field_print;
     actor->draw = minesweeper_field_draw;
     actor->logic = minesweeper_field_logic;
     actor->destroy = minesweeper_field_destroy;
 
-    field->cell_size = game_cell_size;
-    int x_size = field->cols * field->cell_size;
-    int y_size = field->rows * field->cell_size;
-    actor->x = SCR_WIDTH / 2 - x_size / 2;
-    actor->y = SCR_HEIGHT / 2 - y_size / 2;
+    minesweeper_camera_fit(actor);
 
     return actor;
 }
 
 
 
+/*
+ * Sets the field's cell size to the game cell size and moves the camera so
+ * that the whole field fits centered on the screen, never zooming in.
+ */
+void minesweeper_camera_fit(GAME_ACTOR *actor) {
+    MINESWEEPER_FIELD *field = actor->data;
+
+    field->cell_size = game_cell_size;
+    float w = field->cols * field->cell_size, h = field->rows * field->cell_size;
+    zoom = SCR_WIDTH / w < SCR_HEIGHT / h ? SCR_WIDTH / w : SCR_HEIGHT / h;
+    zoom = zoom > 1 ? 1 : zoom;
+    camera_x = w / 2 - SCR_WIDTH / 2 / zoom;
+    camera_y = h / 2 - SCR_HEIGHT / 2 / zoom;
+    minesweeper_camera_clamp(actor);
+}
+
+
+
+/*
+ * Saves the game in progress so that it can be resumed after quitting or a
+ * crash, or removes the snapshot once the game is over. Snapshots of big
+ * boards take a while, so unless \c force is set they're only taken once the
+ * player stops for SAVE_IDLE seconds, or every SAVE_INTERVAL seconds of
+ * continuous play. The snapshot is encoded into a buffer kept across saves
+ * and written to disk by save_write(); while a write is in flight nothing
+ * else is done and a later timer tick tries again.
+ */
+void save_game(MINESWEEPER_FIELD *field, bool force) {
+    double now = al_get_time();
+
+    if (!save_path || save_thread)
+        return;
+    if (game_over || field->move_count == 0) {
+        remove(save_path);
+        save_pending = false;
+        return;
+    }
+    if (!force && now - move_time < SAVE_IDLE && now - save_time < SAVE_INTERVAL)
+        return;
+
+    if (minesweeper_field_save_bound(field) > save_capacity) {
+        save_capacity = minesweeper_field_save_bound(field);
+        free(save_buffer);
+        save_buffer = malloc(save_capacity);
+        assert(save_buffer);
+    }
+    field->time = (double)al_get_timer_count(timer) / GAME_FPS;
+    save_size = minesweeper_field_save(field, save_buffer, save_capacity);
+    save_thread = al_create_thread(save_write, NULL);
+    assert(save_thread);
+    al_start_thread(save_thread);
+    save_time = now;
+    save_pending = false;
+}
+
+
+
+/*
+ * Called after every move, leaves the snapshot to save_game() on a later
+ * timer tick.
+ */
+void save_game_later(void) {
+    save_pending = true;
+    move_time = al_get_time();
+}
+
+
+
+/*
+ * Snapshot writing thread. Writes the snapshot encoded by save_game() and
+ * reports the result with a SAVE_EVENT_WRITTEN event.
+ */
+void *save_write(ALLEGRO_THREAD *thread, void *arg) {
+    ALLEGRO_EVENT event = {0};
+
+    event.user.type = SAVE_EVENT_WRITTEN;
+    event.user.data1 = minesweeper_save_write_file(save_path, save_buffer, save_size);
+    al_emit_user_event(&background_source, &event, NULL);
+    return NULL;
+}
+
+
+
+void save_written(ALLEGRO_EVENT *event) {
+    al_destroy_thread(save_thread);
+    save_thread = NULL;
+    if (!event->user.data1)
+        printf("Couldn't save the game to %s\n", save_path);
+}
+
+
+
+/*
+ * Waits for the snapshot being written, if any, before quitting.
+ */
+void save_wait(void) {
+    if (save_thread)
+        al_destroy_thread(save_thread);
+    save_thread = NULL;
+}
+
+
+
+/*
+ * Resumes the game saved by save_game(), if any, and sets the file where the
+ * game will be saved from now on.
+ */
+void resume_game(GAME_ACTOR *actor) {
+    MINESWEEPER_FIELD *field = actor->data;
+    ALLEGRO_PATH *path = al_get_standard_path(ALLEGRO_USER_DATA_PATH);
+
+    if (!path)
+        return;
+    al_make_directory(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+    al_set_path_filename(path, SAVE_FILE);
+    save_path = strdup(al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP));
+    al_destroy_path(path);
+    assert(save_path);
+
+    if (!minesweeper_field_load_file(field, save_path))
+        return;
+    printf("Resuming the game saved in %s\n", save_path);
+    game_rows = field->rows;
+    game_cols = field->cols;
+    minesweeper_camera_fit(actor);
+    al_set_timer_count(timer, field->time * GAME_FPS);
+    game_over = field->complete;
+    scene_valid = lod_valid = false;
+}
+
+
+
 GAME_ACTOR *game_actor_create() {
     GAME_ACTOR *actor = calloc(sizeof(GAME_ACTOR), 1);
     assert(actor);
@@ -286,8 +938,29 @@ void game_actor_logic(GAME_ACTOR *actor, ALLEGRO_EVENT *event) {
  */
 void logic(ALLEGRO_EVENT *event) {
     if (event->type == ALLEGRO_EVENT_TIMER) {
+        if (event->any.source == al_get_timer_event_source(fade_timer)) {
+            fade += 1.0 / FADE_FRAMES;
+            if (fade >= 1) {
+                fade = 1;
+                al_stop_timer(fade_timer);
+                al_destroy_bitmap(old_wall);
+                al_destroy_bitmap(old_board_base);
+                old_wall = old_board_base = NULL;
+            }
+            scene_valid = false;
+        }
+        else if (save_pending)
+            save_game(game_actor->data, false);
         redraw = true;
     }
+    else if (event->type == BACKGROUND_EVENT_LOADED) {
+        background_loaded(event);
+        redraw = true;
+    }
+    else if (event->type == NOGUESS_EVENT_READY)
+        noguess_ready(event);
+    else if (event->type == SAVE_EVENT_WRITTEN)
+        save_written(event);
     else {
         game_actor_logic(game_actor, event);
 #ifdef DEBUG
@@ -324,22 +997,10 @@ void logic(ALLEGRO_EVENT *event) {
 
 
 /*
- * Screen update.
+ * Screen update. The background and the board are cached by the field
+ * actor, see minesweeper_scene_render().
  */
 void update() {
-    al_clear_to_color(al_map_rgb(255, 255, 255));
-    MINESWEEPER_FIELD *field = game_actor->data;
-    int w = al_get_bitmap_width(background), 
-        h = al_get_bitmap_height(background);
-    float scalex = SCR_WIDTH * 1.0 / w,
-          scaley = SCR_HEIGHT * 1.0 / h;
-    int w2 = field->cell_size * field->cols, 
-        h2 = field->cell_size * field->rows,
-        sx = w / 2 - w2 / scalex / 2,                        // Bitmap region
-        sy = h / 2 - h2 / scaley / 2;
-    al_draw_tinted_scaled_rotated_bitmap_region(threshold, 0, 0, w, h, al_map_rgba(192, 192, 192, 192), 0, 0, 0, 0, scalex, scaley, 0, 0);
-    al_draw_filled_rectangle(game_actor->x, game_actor->y, game_actor->x + w2, game_actor->y + h2, al_map_rgb(255, 255, 255));
-    al_draw_tinted_scaled_rotated_bitmap_region(background, sx, sy, w2 / scalex, h2 / scaley, al_map_rgba(128, 128, 128, 128), 0, 0, SCR_WIDTH / 2 - w2 / 2, SCR_HEIGHT / 2 - h2 / 2, scalex, scaley, 0, 0);
     game_actor_draw(game_actor);
 }
 
@@ -350,6 +1011,129 @@ bool load_embedded_image() {
 
 
 
+/*
+ * Prints the minesweeper engine log messages to the console.
+ */
+void log_console(const char *format, va_list args) {
+    vprintf(format, args);
+}
+
+
+
+/*
+ * Background loading thread. Finds the available background images, loads a
+ * random one and blurs it as memory bitmaps, so that no display is needed,
+ * and hands both to the main thread with a BACKGROUND_EVENT_LOADED event.
+ */
+void *background_load(ALLEGRO_THREAD *thread, void *arg) {
+    ALLEGRO_EVENT event = {0};
+    int count = 0;
+    char *bg_path = arg;
+
+// Find potential background images
+    ALLEGRO_FS_ENTRY *dir = al_create_fs_entry(bg_path);
+    if (al_fs_entry_exists(dir) && al_open_directory(dir)) {
+        ALLEGRO_FS_ENTRY *file = al_read_directory(dir);
+        printf("Available background images: \n");
+        while (file != NULL && count < MAX_BACKGROUNDS) {
+            ALLEGRO_PATH *path = al_create_path(al_get_fs_entry_name(file));
+            assert(path);
+            if (strcmp(al_get_path_extension(path), ".jpg") == 0) {
+                printf("file: %s\n", al_get_fs_entry_name(file));
+                bg[count++] = path;
+            }
+            else al_destroy_path(path);
+            al_destroy_fs_entry(file);
+            file = al_read_directory(dir);
+        }
+        assert(al_close_directory(dir));
+    }
+    al_destroy_fs_entry(dir);
+
+// Randomly choose background images from those available
+    event.user.type = BACKGROUND_EVENT_LOADED;
+    if (count > 0) {
+        int choice = rand() % count;
+        printf("Choosing background %d: %s\n", choice, al_path_cstr(bg[choice], '/'));
+        al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+        ALLEGRO_BITMAP *image = al_load_bitmap(al_path_cstr(bg[choice], '/'));
+        if (image) {
+            event.user.data1 = (intptr_t)image;
+            event.user.data2 = (intptr_t)bmputils_fast_blur(image, BLUR_RADIUS, SCR_WIDTH, SCR_HEIGHT, BLUR_PASSES);
+            assert(event.user.data2);
+        }
+    }
+    al_emit_user_event(&background_source, &event, NULL);
+    return NULL;
+}
+
+
+
+/*
+ * No-guess generation thread. Only reads the size and density of the game 
+ * field, which don't change until the game is over, and hands the layout to 
+ * the main thread with a NOGUESS_EVENT_READY event. The layout may need a 
+ * guess if none was found within NOGUESS_SECONDS.
+ */
+void *noguess_generate(ALLEGRO_THREAD *thread, void *arg) {
+    MINESWEEPER_FIELD *field = arg;
+    MINESWEEPER_FIELD *layout = minesweeper_field_create_seeded(field->rows, field->cols, noguess_seed);
+    ALLEGRO_EVENT event = {0};
+
+    layout->density = field->density;
+    minesweeper_field_reset_noguess(layout, noguess_row, noguess_col, true, NOGUESS_THREADS, INT_MAX, NOGUESS_SECONDS);
+    event.user.type = NOGUESS_EVENT_READY;
+    event.user.data1 = (intptr_t)layout;
+    al_emit_user_event(&background_source, &event, NULL);
+    return NULL;
+}
+
+
+
+/*
+ * Copies the layout found by noguess_generate() to the game field and plays 
+ * the first move on it. The clock starts from this move.
+ */
+void noguess_ready(ALLEGRO_EVENT *event) {
+    MINESWEEPER_FIELD *field = game_actor->data;
+    MINESWEEPER_FIELD *layout = (MINESWEEPER_FIELD *)event->user.data1;
+
+    al_destroy_thread(noguess_thread);
+    noguess_thread = NULL;
+    minesweeper_field_copy_mines(field, layout, false);
+    minesweeper_field_destroy(layout);
+    al_set_timer_count(timer, 0);
+    uncover_cell(field, noguess_row, noguess_col);
+}
+
+
+
+/*
+ * Replaces the solid background with the images loaded by background_load()
+ * and starts fading them in.
+ */
+void background_loaded(ALLEGRO_EVENT *event) {
+    al_destroy_thread(background_thread);
+    background_thread = NULL;
+    if (!event->user.data1)
+        return;
+
+    al_destroy_bitmap(background);
+    al_destroy_bitmap(threshold);
+    background = (ALLEGRO_BITMAP *)event->user.data1;
+    threshold = (ALLEGRO_BITMAP *)event->user.data2;
+    al_convert_bitmap(background);
+// The blurred image is small, filter it when scaling it up
+    int flags = al_get_new_bitmap_flags();
+    al_set_new_bitmap_flags(flags | ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR);
+    al_convert_bitmap(threshold);
+    al_set_new_bitmap_flags(flags);
+    minesweeper_backdrop_create();
+    al_start_timer(fade_timer);
+}
+
+
+
 /*
  * Game initialization.
  */
@@ -371,9 +1155,13 @@ void initialization(int argc, char **argv) {
     printf("Android version: %s", al_android_get_os_version());
     al_android_set_apk_file_interface();
 #endif
-    font_memfile = al_open_memfile(ZillaSlab_Bold_ttf, ZillaSlab_Bold_ttf_len, "r");
+// The cell size never changes, so the font is parsed only once. Measuring the
+// digits caches their glyphs, the only ones drawn on the field.
+    ALLEGRO_FILE *font_memfile = al_open_memfile(ZillaSlab_Bold_ttf, ZillaSlab_Bold_ttf_len, "r");
+    assert(font_memfile);
     font = al_load_ttf_font_f(font_memfile, NULL, MINESWEEPER_CELL_SIZE, 0);
     assert(font);
+    al_get_text_width(font, "0123456789");
     events = al_create_event_queue();
     assert(events);
     timer = al_create_timer(ALLEGRO_BPS_TO_SECS(GAME_FPS));
@@ -384,6 +1172,7 @@ void initialization(int argc, char **argv) {
     al_register_event_source(events, al_get_timer_event_source(timer));
     
     srand(time(NULL));
+    minesweeper_set_log(log_console);
 
 // Game initialization
     ALLEGRO_FILE *memfile = NULL;
@@ -402,47 +1191,28 @@ void initialization(int argc, char **argv) {
     assert(warning && mine && flag);
 
     game_actor = minesweeper_field_actor(game_rows, game_cols);
+    resume_game(game_actor);
 #ifdef DEBUG
     game_actor_print(game_actor);
 #endif
 
-// Find potential background images
-    int count = 0;
-    char *bg_path = "data";
-    if (argc > 1) bg_path = argv[1];
-    ALLEGRO_FS_ENTRY *dir = al_create_fs_entry(bg_path);
-    if (al_fs_entry_exists(dir) && al_open_directory(dir)) {
-        ALLEGRO_FS_ENTRY *file = al_read_directory(dir);
-        printf("Available background images: \n");
-        while (file != NULL && count < MAX_BACKGROUNDS) {
-            ALLEGRO_PATH *path = al_create_path(al_get_fs_entry_name(file));
-            assert(path);
-            if (strcmp(al_get_path_extension(path), ".jpg") == 0) {
-                printf("file: %s\n", al_get_fs_entry_name(file));
-                bg[count++] = path;
-            }
-            else al_destroy_path(path);
-            file = al_read_directory(dir);
-        }
-        assert(al_close_directory(dir));
-    }
-
-// Randomly choose background images from those available
-    if (count > 0) {
-        int choice = rand() % count;
-        printf("Choosing background %d: %s\n", choice, al_path_cstr(bg[choice], '/'));
-        background = al_load_bitmap(al_path_cstr(bg[choice], '/'));
-        // threshold = al_clone_bitmap(background);
-        assert(background);
-    }
-    else {
-        background = al_create_bitmap(2, 2);
-        al_set_target_bitmap(background);
-        al_clear_to_color(al_map_rgb(192, 192, 192));
-        al_set_target_backbuffer(display);
-    }
-    threshold = bmputils_box_blur(background, 25);
+// Start on a solid background color while the background images load
+    background = al_create_bitmap(2, 2);
+    al_set_target_bitmap(background);
+    al_clear_to_color(al_map_rgb(192, 192, 192));
+    al_set_target_backbuffer(display);
+    threshold = bmputils_fast_blur(background, BLUR_RADIUS, SCR_WIDTH, SCR_HEIGHT, BLUR_PASSES);
     assert(threshold);
+    minesweeper_backdrop_create();
+
+    fade_timer = al_create_timer(ALLEGRO_BPS_TO_SECS(FADE_FPS));
+    assert(fade_timer);
+    al_register_event_source(events, al_get_timer_event_source(fade_timer));
+    al_init_user_event_source(&background_source);
+    al_register_event_source(events, &background_source);
+    background_thread = al_create_thread(background_load, argc > 1 ? argv[1] : "data");
+    assert(background_thread);
+    al_start_thread(background_thread);
 }
 
 
@@ -463,5 +1233,12 @@ int main(int argc, char **argv) {
             redraw = false;
         }  
     }
+
+// Let the snapshot being written finish and save the last moves, if any
+    save_wait();
+    if (save_pending) {
+        save_game(game_actor->data, true);
+        save_wait();
+    }
 }
 
@@ -34,55 +34,662 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
+#include <pthread.h>
 #include "monstrominas.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MINESWEEPER_X86
+#include <immintrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#define MINESWEEPER_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 
 
-void minesweeper_field_print(MINESWEEPER_FIELD *field) {
-    bool (*cells)[field->cols] = (bool (*)[])field->cells;
-    int (*hints)[field->cols] = (int (*)[])field->hints;
-    bool (*state)[field->cols] = (bool (*)[])field->state;
+static MINESWEEPER_LOG minesweeper_log_function = NULL;
+
+
+
+/**
+ * Sets the function that receives the engine's log messages. Logging is off 
+ * (\c NULL) by default, so the engine has no I/O side effects of its own.
+ */
+void minesweeper_set_log(MINESWEEPER_LOG log) {
+    minesweeper_log_function = log;
+}
+
 
+
+static void minesweeper_log(const char *format, ...) {
+    va_list args;
+
+    if (!minesweeper_log_function) return;
+    va_start(args, format);
+    minesweeper_log_function(format, args);
+    va_end(args);
+}
+
+
+
+void minesweeper_field_print(MINESWEEPER_FIELD *field) {
     for (int row = 0; row < field->rows; row++) {
         for (int col = 0; col < field->cols; col++)
-            printf("%d", cells[row][col] ? 1 : 0);
-        printf("\t");
+            minesweeper_log("%d", minesweeper_cell_mine(field, row, col) ? 1 : 0);
+        minesweeper_log("\t");
         for (int col = 0; col < field->cols; col++)
-            printf("%d", hints[row][col]);
-        printf("\t");
+            minesweeper_log("%d", minesweeper_cell_hint(field, row, col));
+        minesweeper_log("\t");
         for (int col = 0; col < field->cols; col++)
-            printf("%d", state[row][col] ? 0 : 1);
-        printf("\n");
+            minesweeper_log("%d", minesweeper_cell_uncovered(field, row, col) ? 0 : 1);
+        minesweeper_log("\n");
     }
-    printf("\n");
+    minesweeper_log("\n");
 }
 
 
 
-MINESWEEPER_FIELD *minesweeper_field_create(int rows, int cols) {
-    MINESWEEPER_FIELD *field = calloc(sizeof(MINESWEEPER_FIELD), 1);
-    assert(field);
-    rows = rows < 10 ? 10 : rows;
-    cols = cols < 10 ? 10 : cols;
+#ifdef MINESWEEPER_PACKED
+/**
+ * Computes the hints for every cell of a packed field.
+ *
+ * The 3x3 mine count is done 64 cells at a time with a bit-sliced (vertical) 
+ * population count: each bitboard row is added to its shifted copies with 
+ * bitwise full adders, giving 2-bit horizontal sums, and three of those are 
+ * then added into the four bit planes of the final 0-9 count. Only the 
+ * scatter of the planes into hint nibbles is done per cell.
+ */
+static void minesweeper_field_hints(MINESWEEPER_FIELD *field) {
+    int words = field->row_words;
+    uint64_t h0[3], h1[3];
+
+    memset(field->hints, 0, (field->rows * field->cols + 1) / 2);
+    for (int row = 0; row < field->rows; row++)
+        for (int word = 0; word < words; word++) {
+            for (int k = 0; k < 3; k++) {
+                int j = row + k - 1;
+                h0[k] = h1[k] = 0;
+                if (j < 0 || j >= field->rows) continue;
+                const uint64_t *cells = field->cells + j * words;
+                uint64_t m = cells[word];
+                uint64_t l = (m << 1) | (word > 0 ? cells[word - 1] >> 63 : 0);
+                uint64_t r = (m >> 1) | (word < words - 1 ? cells[word + 1] << 63 : 0);
+                h0[k] = l ^ m ^ r;
+                h1[k] = (l & m) | (r & (l ^ m));
+            }
+
+        // Add the three 2-bit row sums into a 4-bit count
+            uint64_t s0 = h0[0] ^ h0[1], carry = h0[0] & h0[1];
+            uint64_t s1 = h1[0] ^ h1[1] ^ carry;
+            uint64_t s2 = (h1[0] & h1[1]) | (carry & (h1[0] ^ h1[1]));
+            uint64_t c0 = s0 ^ h0[2];
+            carry = s0 & h0[2];
+            uint64_t c1 = s1 ^ h1[2] ^ carry;
+            carry = (s1 & h1[2]) | (carry & (s1 ^ h1[2]));
+            uint64_t c2 = s2 ^ carry;
+            uint64_t c3 = s2 & carry;
+
+            int first = word * 64, count = field->cols - first < 64 ? field->cols - first : 64;
+            int index = row * field->cols + first;
+            for (int bit = 0; bit < count; bit++, index++) {
+                int hint = ((c0 >> bit) & 1) | (((c1 >> bit) & 1) << 1) | (((c2 >> bit) & 1) << 2) | (((c3 >> bit) & 1) << 3);
+                field->hints[index >> 1] |= hint << ((index & 1) << 2);
+            }
+        }
+}
+#else
+/*
+ * Hint kernels for the unpacked layout. The 3x3 mine count is separable: 
+ * every row of cells is first reduced to horizontal sums of three cells and 
+ * the hints are then the sum of three consecutive row sums. Both passes work 
+ * on bytes, so the SIMD kernels handle 16 or 32 cells per instruction; the 
+ * best available pair is chosen at runtime by minesweeper_hints_init().
+ */
+static void hints_row_sum_scalar(const uint8_t *cells, uint8_t *sums, int cols, int col) {
+    if (col == 1) sums[0] = cells[0] + cells[1];
+    for (; col < cols - 1; col++)
+        sums[col] = cells[col - 1] + cells[col] + cells[col + 1];
+    sums[cols - 1] = cells[cols - 2] + cells[cols - 1];
+}
+
+static void hints_col_sum_scalar(const uint8_t *above, const uint8_t *sums, const uint8_t *below, int *hints, int cols, int col) {
+    for (; col < cols; col++)
+        hints[col] = above[col] + sums[col] + below[col];
+}
+
+static void hints_row_sum_c(const uint8_t *cells, uint8_t *sums, int cols) {
+    hints_row_sum_scalar(cells, sums, cols, 1);
+}
+
+static void hints_col_sum_c(const uint8_t *above, const uint8_t *sums, const uint8_t *below, int *hints, int cols) {
+    hints_col_sum_scalar(above, sums, below, hints, cols, 0);
+}
+
+#ifdef MINESWEEPER_X86
+__attribute__((target("sse2")))
+static void hints_row_sum_sse2(const uint8_t *cells, uint8_t *sums, int cols) {
+    int col = 1;
+
+    sums[0] = cells[0] + cells[1];
+    for (; col + 16 < cols; col += 16) {
+        __m128i left = _mm_loadu_si128((const __m128i *)(cells + col - 1));
+        __m128i middle = _mm_loadu_si128((const __m128i *)(cells + col));
+        __m128i right = _mm_loadu_si128((const __m128i *)(cells + col + 1));
+        _mm_storeu_si128((__m128i *)(sums + col), _mm_add_epi8(_mm_add_epi8(left, middle), right));
+    }
+    hints_row_sum_scalar(cells, sums, cols, col);
+}
+
+__attribute__((target("sse2")))
+static void hints_col_sum_sse2(const uint8_t *above, const uint8_t *sums, const uint8_t *below, int *hints, int cols) {
+    const __m128i zero = _mm_setzero_si128();
+    int col = 0;
+
+    for (; col + 16 <= cols; col += 16) {
+        __m128i sum = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(above + col)), _mm_loadu_si128((const __m128i *)(sums + col)));
+        sum = _mm_add_epi8(sum, _mm_loadu_si128((const __m128i *)(below + col)));
+        __m128i low = _mm_unpacklo_epi8(sum, zero), high = _mm_unpackhi_epi8(sum, zero);
+        _mm_storeu_si128((__m128i *)(hints + col), _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128((__m128i *)(hints + col + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128((__m128i *)(hints + col + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128((__m128i *)(hints + col + 12), _mm_unpackhi_epi16(high, zero));
+    }
+    hints_col_sum_scalar(above, sums, below, hints, cols, col);
+}
+
+__attribute__((target("avx2")))
+static void hints_row_sum_avx2(const uint8_t *cells, uint8_t *sums, int cols) {
+    int col = 1;
+
+    sums[0] = cells[0] + cells[1];
+    for (; col + 32 < cols; col += 32) {
+        __m256i left = _mm256_loadu_si256((const __m256i *)(cells + col - 1));
+        __m256i middle = _mm256_loadu_si256((const __m256i *)(cells + col));
+        __m256i right = _mm256_loadu_si256((const __m256i *)(cells + col + 1));
+        _mm256_storeu_si256((__m256i *)(sums + col), _mm256_add_epi8(_mm256_add_epi8(left, middle), right));
+    }
+    hints_row_sum_scalar(cells, sums, cols, col);
+}
+
+__attribute__((target("avx2")))
+static void hints_col_sum_avx2(const uint8_t *above, const uint8_t *sums, const uint8_t *below, int *hints, int cols) {
+    int col = 0;
+
+    for (; col + 16 <= cols; col += 16) {
+        __m128i sum = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(above + col)), _mm_loadu_si128((const __m128i *)(sums + col)));
+        sum = _mm_add_epi8(sum, _mm_loadu_si128((const __m128i *)(below + col)));
+        _mm256_storeu_si256((__m256i *)(hints + col), _mm256_cvtepu8_epi32(sum));
+        _mm256_storeu_si256((__m256i *)(hints + col + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(sum, 8)));
+    }
+    hints_col_sum_scalar(above, sums, below, hints, cols, col);
+}
+#endif
+
+static void (*hints_row_sum)(const uint8_t *cells, uint8_t *sums, int cols) = NULL;
+static void (*hints_col_sum)(const uint8_t *above, const uint8_t *sums, const uint8_t *below, int *hints, int cols) = NULL;
+static pthread_once_t minesweeper_hints_once = PTHREAD_ONCE_INIT;
+
+static void minesweeper_hints_init() {
+    hints_row_sum = hints_row_sum_c;
+    hints_col_sum = hints_col_sum_c;
+#ifdef MINESWEEPER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        hints_row_sum = hints_row_sum_avx2;
+        hints_col_sum = hints_col_sum_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        hints_row_sum = hints_row_sum_sse2;
+        hints_col_sum = hints_col_sum_sse2;
+    }
+#endif
+}
+
+
+
+/**
+ * Computes the hints for every cell of the field.
+ *
+ * Only three rows of horizontal sums are alive at any time. They're kept in 
+ * \c field->queue, which is unused outside of minesweeper_field_uncover() and 
+ * always has room for them since fields are at least 10x10 cells.
+ */
+static void minesweeper_field_hints(MINESWEEPER_FIELD *field) {
+    int cols = field->cols, stride = (cols + 63) & ~31;
+    uint8_t *zero = (uint8_t *)field->queue, *sums[3];
+    const uint8_t *cells = (const uint8_t *)field->cells;
+
+    pthread_once(&minesweeper_hints_once, minesweeper_hints_init);
+    for (int k = 0; k < 3; k++)
+        sums[k] = zero + (k + 1) * stride;
+    memset(zero, 0, cols);
+
+    hints_row_sum(cells, sums[0], cols);
+    for (int row = 0; row < field->rows; row++) {
+        const uint8_t *above = row > 0 ? sums[(row - 1) % 3] : zero;
+        const uint8_t *below = zero;
+        if (row + 1 < field->rows) {
+            below = sums[(row + 1) % 3];
+            hints_row_sum(cells + (row + 1) * cols, sums[(row + 1) % 3], cols);
+        }
+        hints_col_sum(above, sums[row % 3], below, field->hints + row * cols, cols);
+    }
+}
+#endif
+
+
+
+/*
+ * Union-find root of a zero-hint cell. Parents always have lower indices than
+ * their children, so roots are the first cell of every opening in row-major
+ * order.
+ */
+static int minesweeper_opening_find(int *parent, int cell) {
+    while (parent[cell] != cell) {
+        parent[cell] = parent[parent[cell]];
+        cell = parent[cell];
+    }
+    return cell;
+}
+
+
+
+/*
+ * Finds the openings bordered by the cell (row, col), which can't be more
+ * than two: separating two openings takes mines at opposite corners of the
+ * cell. Returns their number.
+ */
+static int minesweeper_opening_borders(const MINESWEEPER_FIELD *field, int row, int col, int *openings) {
+    int count = 0;
+
+    for (int j = row - 1; j <= row + 1; j++)
+        for (int i = col - 1; i <= col + 1; i++) {
+            if (j < 0 || j >= field->rows || i < 0 || i >= field->cols) continue;
+            if (minesweeper_cell_mine(field, j, i) || minesweeper_cell_hint(field, j, i) != 0) continue;
+            int opening = field->openings[j * field->cols + i];
+            if (count == 0 || (openings[0] != opening && count == 1))
+                openings[count++] = opening;
+        }
+    return count;
+}
+
+
+
+/*
+ * Lays out the labels and the opening offsets for the current field size in 
+ * their own allocation, growing it if needed. Opening buffers take more 
+ * memory than the rest of the field in the packed layout, so fields that are 
+ * never labelled never allocate them.
+ */
+static void minesweeper_openings_allocate(MINESWEEPER_FIELD *field) {
+    size_t cells = (size_t)field->rows * field->cols;
+    size_t starts = (size_t)(field->rows + 1) / 2 * ((field->cols + 1) / 2) + 1;
+    size_t size = (cells + starts) * sizeof(int);
+
+    if (size > field->opening_arena_size) {
+        free(field->opening_arena);
+        field->opening_arena = malloc(size);
+        assert(field->opening_arena);
+        field->opening_arena_size = size;
+    }
+    field->openings = field->opening_arena;
+    field->opening_start = field->openings + cells;
+}
+
+
+
+/*
+ * Grows the list of opening cells to hold \c count cells. It's sized to the 
+ * openings actually found, which on most boards is far below its bound of 
+ * 1.5 cells per cell.
+ */
+static void minesweeper_opening_cells_reserve(MINESWEEPER_FIELD *field, int count) {
+    if (count * sizeof(int) <= field->opening_cells_size)
+        return;
+    free(field->opening_cells);
+    field->opening_cells = malloc(count * sizeof(int));
+    assert(field->opening_cells);
+    field->opening_cells_size = count * sizeof(int);
+}
+
+
+
+/**
+ * Labels the openings of the field: the 8-connected regions of zero-hint 
+ * cells plus the cells around them, which is what uncovering any of their 
+ * zero-hint cells reveals.
+ *
+ * Labelling costs several times as much as generating the board, so it's 
+ * left to the first move after the first one that uncovers an opening, and 
+ * does nothing once the board is labelled.
+ *
+ * Zero-hint cells are joined with their zero-hint neighbors above and to the 
+ * left with a union-find pass in row-major order, which needs no worklist. 
+ * Roots are then numbered in order and every cell gets the label of its 
+ * opening in \c field->openings, or the first one for the few cells that 
+ * border two openings. The cells of every opening are listed one opening 
+ * after the other in \c field->opening_cells, delimited by 
+ * \c field->opening_start, so uncovering an opening is a walk over a 
+ * contiguous span.
+ *
+ * A cell bordering two openings has mines at two opposite corners and zero-
+ * hint cells at the other two, so there are at most half as many of them as 
+ * there are cells, and no 2x2 block of cells can hold zero-hint cells of two 
+ * openings. That bounds the size of \c field->opening_start.
+ *
+ * Only the labels of the neighbors are looked at while labelling, as 
+ * non-negative labels tell zero-hint cells apart. Border cells are marked 
+ * while labelling as -2 - opening, or INT_MIN + opening if they border a 
+ * second one, so only those few need their neighbors looked up again.
+ */
+void minesweeper_field_label_openings(MINESWEEPER_FIELD *field) {
+    int rows = field->rows, cols = field->cols, cells = rows * cols;
+    int count = 0, borders[2];
+
+    if (field->opening_count >= 0)
+        return;
+    minesweeper_openings_allocate(field);
+    int *label = field->openings, *start = field->opening_start;
+
+// Join every zero-hint cell with the zero-hint cells among its earlier
+// neighbors. If the one above is a zero-hint cell it touches all the others.
+    for (int row = 0; row < rows; row++)
+        for (int col = 0; col < cols; col++) {
+            int cell = row * cols + col;
+            label[cell] = -1;
+            if (minesweeper_cell_mine(field, row, col) || minesweeper_cell_hint(field, row, col) != 0) continue;
+            int parent = cell;
+            if (row > 0 && label[cell - cols] >= 0)
+                parent = cell - cols;
+            else {
+                if (col > 0 && label[cell - 1] >= 0)
+                    parent = cell - 1;
+                else if (row > 0 && col > 0 && label[cell - cols - 1] >= 0)
+                    parent = cell - cols - 1;
+                if (row > 0 && col < cols - 1 && label[cell - cols + 1] >= 0) {
+                    if (parent == cell)
+                        parent = cell - cols + 1;
+                    else {
+                        int a = minesweeper_opening_find(label, parent), b = minesweeper_opening_find(label, cell - cols + 1);
+                        if (a != b)
+                            label[a > b ? a : b] = a < b ? a : b;
+                    }
+                }
+            }
+            label[cell] = parent;
+        }
+
+// Number the roots in order. Parents come first, so they're numbered already.
+    for (int cell = 0; cell < cells; cell++)
+        if (label[cell] >= 0)
+            label[cell] = label[cell] == cell ? count++ : label[label[cell]];
+
+// Mark the border cells from their zero-hint neighbors, which can't be mines,
+// and count the size of every opening
+    memset(start, 0, (count + 1) * sizeof(int));
+    for (int row = 0; row < rows; row++)
+        for (int col = 0; col < cols; col++) {
+            int opening = label[row * cols + col];
+            if (opening < 0) continue;
+            start[opening + 1]++;
+            for (int j = row - 1; j <= row + 1; j++)
+                for (int i = col - 1; i <= col + 1; i++) {
+                    if (j < 0 || j >= rows || i < 0 || i >= cols) continue;
+                    int *border = &label[j * cols + i];
+                    if (*border >= 0 || *border < -1 - cells || *border == -2 - opening) continue;
+                    *border = *border == -1 ? -2 - opening : INT_MIN + (-2 - *border);
+                    start[opening + 1]++;
+                }
+        }
+
+// Lay the openings out one after the other, looking up the second opening
+// of the cells that border two
+    for (int k = 0; k < count; k++)
+        start[k + 1] += start[k];
+    minesweeper_opening_cells_reserve(field, start[count]);
+    for (int cell = 0; cell < cells; cell++) {
+        int opening = label[cell];
+        if (opening == -1) continue;
+        if (opening < -1 - cells) {
+            opening = label[cell] = opening - INT_MIN;
+            minesweeper_opening_borders(field, cell / cols, cell % cols, borders);
+            field->opening_cells[start[borders[0] == opening ? borders[1] : borders[0]]++] = cell;
+        }
+        else if (opening < -1)
+            opening = label[cell] = -2 - opening;
+        field->opening_cells[start[opening]++] = cell;
+    }
+    for (int k = count; k > 0; k--)
+        start[k] = start[k - 1];
+    start[0] = 0;
+    field->opening_count = count;
+}
+
+
+
+/**
+ * Seeds a random number generator. The 256-bit xoshiro256** state is filled 
+ * from \c seed with splitmix64, as recommended by the xoshiro authors. If no 
+ * generator has been plugged into \c rng->next, xoshiro256** is used.
+ */
+void minesweeper_rng_seed(MINESWEEPER_RNG *rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += UINT64_C(0x9E3779B97F4A7C15));
+        z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+        z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+        rng->s[i] = z ^ (z >> 31);
+    }
+    if (!rng->next)
+        rng->next = minesweeper_rng_xoshiro;
+}
+
+
+
+/**
+ * xoshiro256** by David Blackman and Sebastiano Vigna, the default generator.
+ */
+uint64_t minesweeper_rng_xoshiro(MINESWEEPER_RNG *rng) {
+    uint64_t *s = rng->s;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    return result;
+}
+
+
+
+/**
+ * Returns an unbiased random number in [0, n), using Lemire's 
+ * multiply-and-reject method instead of a modulo.
+ */
+uint32_t minesweeper_rng_range(MINESWEEPER_RNG *rng, uint32_t n) {
+    uint64_t m = (rng->next(rng) >> 32) * n;
+    if ((uint32_t)m < n) {
+        uint32_t threshold = -n % n;
+        while ((uint32_t)m < threshold)
+            m = (rng->next(rng) >> 32) * n;
+    }
+    return m >> 32;
+}
+
+
+
+/**
+ * Seeds the field's random number generator, so the same sequence of 
+ * minesweeper_field_reset() calls produces the same boards. The shuffle 
+ * permutation used to place mines is part of that state and is reset too.
+ */
+void minesweeper_field_seed(MINESWEEPER_FIELD *field, uint64_t seed) {
+    for (int i = 0; i < field->rows * field->cols; i++)
+        field->shuffle[i] = i;
+    field->seed = seed;
+    minesweeper_rng_seed(&field->rng, seed);
+}
+
+
+
+/**
+ * Places \c mines mines in the field, leaving the 3x3 zone around (row, col) 
+ * free, and returns the number of mines placed.
+ *
+ * This is a partial Fisher-Yates shuffle over \c field->shuffle, a persistent 
+ * permutation of all the cells in the field: the first draws of the shuffle 
+ * are a uniformly random sequence of distinct cells, and skipping the (at 
+ * most nine) safe cells among them leaves a uniformly random subset of the 
+ * rest. Since any permutation is a valid starting point the array is never 
+ * reinitialized, so this takes O(mines) time. When more than half of the 
+ * candidate cells are mines, the free cells are drawn instead.
+ */
+static int minesweeper_field_place_mines(MINESWEEPER_FIELD *field, int row, int col, int mines) {
+    int cells = field->rows * field->cols, candidates = cells;
+    int *shuffle = field->shuffle;
+
+    for (int j = row - 1; j <= row + 1; j++)
+        for (int i = col - 1; i <= col + 1; i++)
+            if (j >= 0 && j < field->rows && i >= 0 && i < field->cols)
+                candidates--;
+    mines = mines > candidates ? candidates : mines;
+    mines = mines < 0 ? 0 : mines;
+
+    bool complement = mines > candidates / 2;
+    if (complement) {
+#ifdef MINESWEEPER_PACKED
+        uint64_t last = field->cols % 64 ? (UINT64_C(1) << (field->cols % 64)) - 1 : ~UINT64_C(0);
+        for (int j = 0; j < field->rows; j++)
+            for (int i = 0; i < field->row_words; i++)
+                field->cells[j * field->row_words + i] = i == field->row_words - 1 ? last : ~UINT64_C(0);
+#else
+        memset(field->cells, true, cells * sizeof(bool));
+#endif
+        for (int j = row - 1; j <= row + 1; j++)
+            for (int i = col - 1; i <= col + 1; i++)
+                if (j >= 0 && j < field->rows && i >= 0 && i < field->cols)
+                    minesweeper_cell_set_mine(field, j, i, false);
+    }
+
+    int picks = complement ? candidates - mines : mines;
+    for (int i = 0, chosen = 0; chosen < picks; i++) {
+        int j = i + minesweeper_rng_range(&field->rng, cells - i);
+        int cell = shuffle[j];
+        shuffle[j] = shuffle[i];
+        shuffle[i] = cell;
+
+        int candidate_row = cell / field->cols, candidate_col = cell % field->cols;
+        if (abs(row - candidate_row) <= 1 && abs(col - candidate_col) <= 1) continue;
+        minesweeper_cell_set_mine(field, candidate_row, candidate_col, !complement);
+        chosen++;
+    }
+
+    return mines;
+}
+
+
+
+/**
+ * Lays out the field buffers in a single arena, each one starting on its own 
+ * cache line, and returns the number of bytes needed. Pointers are only 
+ * assigned when \c arena isn't \c NULL.
+ */
+static size_t minesweeper_field_layout(MINESWEEPER_FIELD *field, uint8_t *arena) {
+    size_t cells = (size_t)field->rows * field->cols, size = 0;
+#define MINESWEEPER_ARENA_BUFFER(buffer, bytes)                                 \
+    if (arena) field->buffer = (void *)(arena + size);                          \
+    size += ((bytes) + MINESWEEPER_CACHE_LINE - 1) & ~(size_t)(MINESWEEPER_CACHE_LINE - 1);
+
+#ifdef MINESWEEPER_PACKED
+    size_t words = (size_t)field->rows * field->row_words;
+    MINESWEEPER_ARENA_BUFFER(cells, words * sizeof(uint64_t));
+    MINESWEEPER_ARENA_BUFFER(hints, (cells + 1) / 2);
+    MINESWEEPER_ARENA_BUFFER(state, words * sizeof(uint64_t));
+    MINESWEEPER_ARENA_BUFFER(flags, words * sizeof(uint64_t));
+    MINESWEEPER_ARENA_BUFFER(warnings, words * sizeof(uint64_t));
+#else
+    MINESWEEPER_ARENA_BUFFER(cells, cells * sizeof(bool));
+    MINESWEEPER_ARENA_BUFFER(hints, cells * sizeof(int));
+    MINESWEEPER_ARENA_BUFFER(state, cells * sizeof(bool));
+    MINESWEEPER_ARENA_BUFFER(flags, cells * sizeof(int));
+#endif
+    MINESWEEPER_ARENA_BUFFER(queue, cells * sizeof(int));
+    MINESWEEPER_ARENA_BUFFER(shuffle, cells * sizeof(int));
+#undef MINESWEEPER_ARENA_BUFFER
+
+    return size;
+}
+
+
+
+/*
+ * Lays out the field buffers for \c rows by \c cols cells, growing the arena 
+ * if needed, without starting a game on them.
+ */
+static void minesweeper_field_allocate(MINESWEEPER_FIELD *field, int rows, int cols) {
+    bool resized = rows != field->rows || cols != field->cols;
     field->rows = rows;
     field->cols = cols;
-    field->cells = calloc(rows * cols, sizeof(bool));
-    field->hints = calloc(rows * cols, sizeof(int));
-    field->state = calloc(rows * cols, sizeof(bool));
-    field->flags = calloc(rows * cols, sizeof(int));
-    field->cell_count = field->rows * field->cols;
-    field->cell_size = MINESWEEPER_CELL_SIZE;
-    field->move_count = 0;
-    assert(field->cells && field->hints && field->state && field->flags);
+#ifdef MINESWEEPER_PACKED
+    field->row_words = (cols + 63) / 64;
+#endif
+
+    size_t size = minesweeper_field_layout(field, NULL);
+    if (size > field->arena_size) {
+        free(field->arena);
+        field->arena = malloc(size + MINESWEEPER_CACHE_LINE - 1);
+        assert(field->arena);
+        field->arena_size = size;
+        resized = true;
+    }
+    minesweeper_field_layout(field, (uint8_t *)(((uintptr_t)field->arena + MINESWEEPER_CACHE_LINE - 1) & ~(uintptr_t)(MINESWEEPER_CACHE_LINE - 1)));
+
+// The shuffle only needs to be a permutation of the cells, so it's kept 
+// across games of the same shape. Any other change moves or reallocates the 
+// buffers, and the shuffle with them.
+    if (resized)
+        for (int i = 0; i < rows * cols; i++)
+            field->shuffle[i] = i;
+}
+
+
+
+/**
+ * Reuses a field for a new game of \c rows by \c cols cells.
+ *
+ * All the field buffers live in one cache-line aligned arena which is only 
+ * reallocated when the new size doesn't fit in it, so restarting games of the 
+ * same (or a smaller) size never touches the heap.
+ */
+void minesweeper_field_resize(MINESWEEPER_FIELD *field, int rows, int cols) {
+    rows = rows < 10 ? 10 : rows;
+    cols = cols < 10 ? 10 : cols;
+    minesweeper_field_allocate(field, rows, cols);
 
 // minesweeper_field_reset() is called here in case the calling function 
 // doesn't reset the field after the player's first move.
-    minesweeper_field_reset(field, rand() % rows, rand() % cols, true);
-    printf("Created minesweeper field: %dx%d cells, %d mines\n", field->rows, field->cols, field->mine_count);
+    minesweeper_field_reset(field, minesweeper_rng_range(&field->rng, rows), minesweeper_rng_range(&field->rng, cols), true);
+}
+
+
+
+MINESWEEPER_FIELD *minesweeper_field_create(int rows, int cols) {
+    MINESWEEPER_FIELD *field = minesweeper_field_create_seeded(rows, cols, ((uint64_t)rand() << 32) ^ (uint64_t)rand());
+    minesweeper_log("Created minesweeper field: %dx%d cells, %d mines\n", field->rows, field->cols, field->mine_count);
 
     return field;
 }
@@ -90,106 +697,783 @@ MINESWEEPER_FIELD *minesweeper_field_create(int rows, int cols) {
 
 
 /**
- * Resets a game field taking care not to place a mine at (row, col). 
- * This is useful for a new game's first move.
+ * Same as minesweeper_field_create() but seeded with \c seed instead of 
+ * rand(), and without logging, so it's safe to call from any thread and the 
+ * field only depends on \c seed.
  */
-void minesweeper_field_reset(MINESWEEPER_FIELD *field, int row, int col, bool reset_flags) {
+MINESWEEPER_FIELD *minesweeper_field_create_seeded(int rows, int cols, uint64_t seed) {
+    MINESWEEPER_FIELD *field = calloc(sizeof(MINESWEEPER_FIELD), 1);
+    assert(field);
+    field->cell_size = MINESWEEPER_CELL_SIZE;
+    rows = rows < 10 ? 10 : rows;
+    cols = cols < 10 ? 10 : cols;
+    minesweeper_field_allocate(field, rows, cols);
+    minesweeper_field_seed(field, seed);
+    minesweeper_field_generate(field, minesweeper_rng_range(&field->rng, rows), minesweeper_rng_range(&field->rng, cols), true);
+
+    return field;
+}
+
+
+
+/*
+ * Clears the mines and the uncovered cells, and optionally the flags, of a 
+ * field so a new game can start on it.
+ */
+static void minesweeper_field_clear(MINESWEEPER_FIELD *field, bool reset_flags) {
+#ifdef MINESWEEPER_PACKED
+    int words = field->rows * field->row_words;
+    memset(field->cells, 0, words * sizeof(uint64_t));
+    memset(field->state, 0, words * sizeof(uint64_t));
+    if (reset_flags) {
+        memset(field->flags, 0, words * sizeof(uint64_t));
+        memset(field->warnings, 0, words * sizeof(uint64_t));
+    }
+#else
     memset(field->cells, 0, field->rows * field->cols * sizeof(bool));
-    memset(field->hints, 0, field->rows * field->cols * sizeof(int));
     memset(field->state, 0, field->rows * field->cols * sizeof(bool));
     if (reset_flags)
         memset(field->flags, 0, field->rows * field->cols * sizeof(int));
+#endif
+    if (reset_flags)
+        field->flags_count = 0;
+    field->cell_count = field->rows * field->cols;
+    field->move_count = 0;
+    field->time = 0;
+    field->queue_count = 0;
+    field->complete = false;
+}
+
+
+
+/**
+ * Resets a game field taking care not to place a mine at (row, col). 
+ * This is useful for a new game's first move.
+ */
+void minesweeper_field_reset(MINESWEEPER_FIELD *field, int row, int col, bool reset_flags) {
+    minesweeper_field_generate(field, row, col, reset_flags);
+    minesweeper_log("Field reset: %dx%d cells, %d mines (%f mine ratio)\n", field->rows, field->cols, field->mine_count, (float)field->mine_count / (field->rows * field->cols));
+}
+
+
+
+/**
+ * Same as minesweeper_field_reset() but without logging, for callers that 
+ * generate boards in a loop.
+ */
+void minesweeper_field_generate(MINESWEEPER_FIELD *field, int row, int col, bool reset_flags) {
+    minesweeper_field_clear(field, reset_flags);
 
-    int mine_count = 0;
-    bool (*cells)[field->cols] = (bool (*)[])field->cells;
-    int (*hints)[field->cols] = (int (*)[])field->hints;
     float ratio = MINESWEEPER_MIN_RATIO + ((field->rows * field->cols - 100) / 480.) * (MINESWEEPER_MAX_RATIO - MINESWEEPER_MIN_RATIO);
     ratio = ratio > MINESWEEPER_MAX_RATIO ? MINESWEEPER_MAX_RATIO : ratio;
-    int mines = field->rows * field->cols * ratio;
-    field->mine_count = mines;
-    printf("Field reset: %dx%d cells, %d mines (%f mine ratio)", field->rows, field->cols, field->mine_count, ratio);
+    if (field->density > 0)
+        ratio = field->density;
+    field->mine_count = minesweeper_field_place_mines(field, row, col, field->rows * field->cols * ratio);
+
+    minesweeper_field_hints(field);
+    field->opening_count = -1;
+}
 
-    while (mine_count < mines) {
-        int candidate_row = rand() % field->rows;
-        int candidate_column = rand() % field->cols;
-        if (cells[candidate_row][candidate_column] || abs(row - candidate_row) < 1 || abs(col - candidate_column) < 1) continue;
-        cells[candidate_row][candidate_column] = true;
-        mine_count++;
+
+
+/**
+ * Replaces the mines of \c field with those of \c source, a field of the same 
+ * size, and starts a new game on it.
+ */
+void minesweeper_field_copy_mines(MINESWEEPER_FIELD *field, const MINESWEEPER_FIELD *source, bool reset_flags) {
+    assert(field->rows == source->rows && field->cols == source->cols);
+    minesweeper_field_clear(field, reset_flags);
+#ifdef MINESWEEPER_PACKED
+    memcpy(field->cells, source->cells, field->rows * field->row_words * sizeof(uint64_t));
+    memcpy(field->hints, source->hints, (field->rows * field->cols + 1) / 2);
+#else
+    memcpy(field->cells, source->cells, field->rows * field->cols * sizeof(bool));
+    memcpy(field->hints, source->hints, field->rows * field->cols * sizeof(int));
+#endif
+    if (source->opening_count >= 0) {
+        minesweeper_openings_allocate(field);
+        minesweeper_opening_cells_reserve(field, source->opening_start[source->opening_count]);
+        memcpy(field->openings, source->openings, field->rows * field->cols * sizeof(int));
+        memcpy(field->opening_cells, source->opening_cells, source->opening_start[source->opening_count] * sizeof(int));
+        memcpy(field->opening_start, source->opening_start, (source->opening_count + 1) * sizeof(int));
     }
+    field->opening_count = source->opening_count;
+    field->mine_count = source->mine_count;
+}
 
-// Four nested for() loops, it's ugly, I know :(
-    for (int row = 0; row < field->rows; row++)
-        for (int col = 0; col < field->cols; col++) {
-            int trow = row - 1, tcol = col - 1;
-            for (int j = trow; j < trow + 3; j++) {
-                if (j < 0 || j >= field->rows) continue;
-                for (int i = tcol; i < tcol + 3; i++) {
-                    if (i < 0 || i >= field->cols) continue;
-                    if (cells[j][i]) hints[row][col]++;
+
+
+/*
+ * Binomial coefficients C(n, k) for 0 <= k <= n <= MINESWEEPER_CODEC_SEGMENT, 
+ * as 256-bit little-endian numbers, and the bits needed to store any rank 
+ * below each of them. Built once, on first use, and kept for the lifetime of 
+ * the program.
+ */
+static uint64_t (*minesweeper_codec_binomials)[MINESWEEPER_CODEC_WORDS];
+static uint16_t *minesweeper_codec_bits;
+static pthread_once_t minesweeper_codec_once = PTHREAD_ONCE_INIT;
+
+#define MINESWEEPER_CODEC_INDEX(n, k)   ((n) * ((n) + 1) / 2 + (k))
+
+
+
+static void minesweeper_codec_init() {
+    int size = MINESWEEPER_CODEC_INDEX(MINESWEEPER_CODEC_SEGMENT + 1, 0);
+    minesweeper_codec_binomials = calloc(size, sizeof(*minesweeper_codec_binomials));
+    minesweeper_codec_bits = calloc(size, sizeof(*minesweeper_codec_bits));
+    assert(minesweeper_codec_binomials && minesweeper_codec_bits);
+
+    for (int n = 0; n <= MINESWEEPER_CODEC_SEGMENT; n++)
+        for (int k = 0; k <= n; k++) {
+            uint64_t *c = minesweeper_codec_binomials[MINESWEEPER_CODEC_INDEX(n, k)], largest[MINESWEEPER_CODEC_WORDS];
+            uint64_t carry = 0, borrow = 1;
+            for (int w = 0; w < MINESWEEPER_CODEC_WORDS; w++) {
+                if (k == 0 || k == n)
+                    c[w] = w == 0;
+                else {
+                    uint64_t a = minesweeper_codec_binomials[MINESWEEPER_CODEC_INDEX(n - 1, k - 1)][w];
+                    uint64_t sum = a + minesweeper_codec_binomials[MINESWEEPER_CODEC_INDEX(n - 1, k)][w];
+                    c[w] = sum + carry;
+                    carry = (sum < a) | (c[w] < sum);
                 }
+                largest[w] = c[w] - borrow;
+                borrow = borrow && c[w] == 0;
             }
+            int bits = 0;
+            for (int w = MINESWEEPER_CODEC_WORDS - 1; w >= 0 && !bits; w--)
+                if (largest[w])
+                    bits = 64 * w + 64 - __builtin_clzll(largest[w]);
+            minesweeper_codec_bits[MINESWEEPER_CODEC_INDEX(n, k)] = bits;
         }
 }
 
 
 
+/*
+ * Compares two 256-bit numbers.
+ */
+static int minesweeper_codec_compare(const uint64_t *a, const uint64_t *b) {
+    for (int w = MINESWEEPER_CODEC_WORDS - 1; w >= 0; w--)
+        if (a[w] != b[w])
+            return a[w] < b[w] ? -1 : 1;
+    return 0;
+}
+
+
+
+/*
+ * Writes the low \c bits bits of \c value at bit \c *position of \c buffer, 
+ * which must be zeroed, least significant bit first.
+ */
+static void minesweeper_codec_put(uint8_t *buffer, size_t *position, uint64_t value, int bits) {
+    while (bits > 0) {
+        int shift = *position & 7, count = 8 - shift < bits ? 8 - shift : bits;
+        buffer[*position >> 3] |= (value & ((1u << count) - 1)) << shift;
+        value >>= count;
+        bits -= count;
+        *position += count;
+    }
+}
+
+
+
+static uint64_t minesweeper_codec_get(const uint8_t *buffer, size_t *position, int bits) {
+    uint64_t value = 0;
+
+    for (int done = 0; done < bits;) {
+        int shift = *position & 7, count = 8 - shift < bits - done ? 8 - shift : bits - done;
+        value |= (uint64_t)((buffer[*position >> 3] >> shift) & ((1u << count) - 1)) << done;
+        done += count;
+        *position += count;
+    }
+    return value;
+}
+
+
+
+/*
+ * Bits taken by the mine count of a segment of \c length cells.
+ */
+static int minesweeper_codec_count_bits(int length) {
+    return 32 - __builtin_clz(length);
+}
+
+
+
+/**
+ * Encodes the mine layout of the field into \c buffer, or only returns the 
+ * size of the encoding if \c buffer is \c NULL.
+ *
+ * The cells are split, in row-major order, into segments of 
+ * MINESWEEPER_CODEC_SEGMENT cells. Each segment takes its mine count 
+ * followed by the rank of its mines among all the layouts with that many 
+ * mines, in the combinatorial number system: the sum of C(c_i, i) over the 
+ * mine cells c_1 < ... < c_k of the segment. That's the fewest whole bits 
+ * that can tell the layouts of a segment apart, so a full segment takes less 
+ * than 10 bits, the count and a partial bit, over the information-theoretic 
+ * minimum. 
+ * Segments are small enough that the ranks are sums of 256-bit binomial 
+ * coefficients from a table.
+ *
+ * @return the number of bytes of the encoding, or 0 if it doesn't fit in 
+ * \c size bytes
+ */
+size_t minesweeper_field_encode_mines(const MINESWEEPER_FIELD *field, uint8_t *buffer, size_t size) {
+    int cells = field->rows * field->cols, row = 0, col = 0;
+    size_t position = 0;
+
+    pthread_once(&minesweeper_codec_once, minesweeper_codec_init);
+    if (buffer)
+        memset(buffer, 0, size);
+    for (int start = 0; start < cells; start += MINESWEEPER_CODEC_SEGMENT) {
+        int length = cells - start < MINESWEEPER_CODEC_SEGMENT ? cells - start : MINESWEEPER_CODEC_SEGMENT;
+        uint64_t rank[MINESWEEPER_CODEC_WORDS] = {0};
+        int count = 0;
+
+        for (int cell = 0; cell < length; cell++) {
+        // C(cell, count) is 0 while the first cells are all mines
+            if (minesweeper_cell_mine(field, row, col) && ++count <= cell) {
+                const uint64_t *c = minesweeper_codec_binomials[MINESWEEPER_CODEC_INDEX(cell, count)];
+                uint64_t carry = 0;
+                for (int w = 0; w < MINESWEEPER_CODEC_WORDS; w++) {
+                    uint64_t sum = rank[w] + c[w], total = sum + carry;
+                    carry = (sum < c[w]) | (total < sum);
+                    rank[w] = total;
+                }
+            }
+            if (++col == field->cols) {
+                col = 0;
+                row++;
+            }
+        }
+
+        int bits = minesweeper_codec_bits[MINESWEEPER_CODEC_INDEX(length, count)];
+        size_t end = position + minesweeper_codec_count_bits(length) + bits;
+        if (buffer && (end + 7) / 8 > size)
+            return 0;
+        if (buffer) {
+            minesweeper_codec_put(buffer, &position, count, minesweeper_codec_count_bits(length));
+            for (int w = 0; bits > 0; w++, bits -= 64)
+                minesweeper_codec_put(buffer, &position, rank[w], bits < 64 ? bits : 64);
+        }
+        position = end;
+    }
+
+    return (position + 7) / 8;
+}
+
+
+
+/*
+ * Reads the mine count and the rank of the next segment, of \c length cells, 
+ * at bit \c *position of an encoding of \c size bytes.
+ *
+ * @return \c false if the segment is truncated or its rank is out of range
+ */
+static bool minesweeper_codec_segment(const uint8_t *buffer, size_t size, size_t *position, int length, int *count, uint64_t *rank) {
+    if (*position + minesweeper_codec_count_bits(length) > size * 8) return false;
+    *count = minesweeper_codec_get(buffer, position, minesweeper_codec_count_bits(length));
+    if (*count > length) return false;
+    int bits = minesweeper_codec_bits[MINESWEEPER_CODEC_INDEX(length, *count)];
+    if (*position + bits > size * 8) return false;
+
+    memset(rank, 0, MINESWEEPER_CODEC_WORDS * sizeof(uint64_t));
+    for (int w = 0; bits > 0; w++, bits -= 64)
+        rank[w] = minesweeper_codec_get(buffer, position, bits < 64 ? bits : 64);
+    return minesweeper_codec_compare(rank, minesweeper_codec_binomials[MINESWEEPER_CODEC_INDEX(length, *count)]) < 0;
+}
+
+
+
+/*
+ * Checks that \c buffer holds a valid encoding of a layout of \c cells 
+ * cells, without decoding it.
+ */
+static bool minesweeper_codec_valid(int cells, const uint8_t *buffer, size_t size) {
+    uint64_t rank[MINESWEEPER_CODEC_WORDS];
+    size_t position = 0;
+    int count;
+
+    pthread_once(&minesweeper_codec_once, minesweeper_codec_init);
+    for (int start = 0; start < cells; start += MINESWEEPER_CODEC_SEGMENT) {
+        int length = cells - start < MINESWEEPER_CODEC_SEGMENT ? cells - start : MINESWEEPER_CODEC_SEGMENT;
+        if (!minesweeper_codec_segment(buffer, size, &position, length, &count, rank)) return false;
+    }
+    return true;
+}
+
+
+
+/**
+ * Starts a new game on the field with the mine layout encoded in \c buffer by 
+ * minesweeper_field_encode_mines() for a field of the same size.
+ *
+ * @return \c false if \c buffer doesn't hold a valid layout, in which case 
+ * the field is left untouched
+ */
+bool minesweeper_field_decode_mines(MINESWEEPER_FIELD *field, const uint8_t *buffer, size_t size, bool reset_flags) {
+    int cells = field->rows * field->cols;
+    size_t position = 0;
+
+    if (!minesweeper_codec_valid(cells, buffer, size)) return false;
+    minesweeper_field_clear(field, reset_flags);
+    field->mine_count = 0;
+    for (int start = 0; start < cells; start += MINESWEEPER_CODEC_SEGMENT) {
+        int length = cells - start < MINESWEEPER_CODEC_SEGMENT ? cells - start : MINESWEEPER_CODEC_SEGMENT;
+        uint64_t rank[MINESWEEPER_CODEC_WORDS];
+        int count;
+
+        minesweeper_codec_segment(buffer, size, &position, length, &count, rank);
+
+    // The largest mine cell is the largest c with C(c, count) <= rank, and 
+    // so on down to the smallest
+        for (int cell = length - 1, k = count; k > 0; cell--, k--) {
+            while (cell >= k && minesweeper_codec_compare(minesweeper_codec_binomials[MINESWEEPER_CODEC_INDEX(cell, k)], rank) > 0)
+                cell--;
+            if (cell >= k) {
+                const uint64_t *c = minesweeper_codec_binomials[MINESWEEPER_CODEC_INDEX(cell, k)];
+                uint64_t borrow = 0;
+                for (int w = 0; w < MINESWEEPER_CODEC_WORDS; w++) {
+                    uint64_t difference = rank[w] - c[w], total = difference - borrow;
+                    borrow = (rank[w] < c[w]) | (difference < borrow);
+                    rank[w] = total;
+                }
+            }
+            minesweeper_cell_set_mine(field, (start + cell) / field->cols, (start + cell) % field->cols, true);
+        }
+        field->mine_count += count;
+    }
+    minesweeper_field_hints(field);
+    field->opening_count = -1;
+
+    return true;
+}
+
+
+
+/*
+ * Snapshot header, all numbers little-endian. The checksum is the CRC-32 of 
+ * everything after it.
+ */
+#define MINESWEEPER_SAVE_MAGIC      "MONSTSAV"
+#define MINESWEEPER_SAVE_HEADER     88
+#define MINESWEEPER_SAVE_CHECKSUM   12      // Offset of the checksum, covering everything after it
+#define MINESWEEPER_SAVE_ROWS       16
+#define MINESWEEPER_SAVE_COLS       20
+#define MINESWEEPER_SAVE_MOVES      24
+#define MINESWEEPER_SAVE_MINES      28      // Bytes of the encoded mine layout
+#define MINESWEEPER_SAVE_TIME       32
+#define MINESWEEPER_SAVE_RNG        40
+#define MINESWEEPER_SAVE_SEED       72
+#define MINESWEEPER_SAVE_DENSITY    80
+
+static uint32_t minesweeper_crc_table[256];
+static pthread_once_t minesweeper_crc_once = PTHREAD_ONCE_INIT;
+
+
+
+static void minesweeper_crc_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        minesweeper_crc_table[i] = crc;
+    }
+}
+
+
+
+static uint32_t minesweeper_crc32(const uint8_t *buffer, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+
+    pthread_once(&minesweeper_crc_once, minesweeper_crc_init);
+    for (size_t i = 0; i < size; i++)
+        crc = (crc >> 8) ^ minesweeper_crc_table[(crc ^ buffer[i]) & 0xFF];
+    return ~crc;
+}
+
+
+
+static void minesweeper_save_put(uint8_t *buffer, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        buffer[i] = value >> (8 * i);
+}
+
+
+
+static uint64_t minesweeper_save_get(const uint8_t *buffer, int bytes) {
+    uint64_t value = 0;
+
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t)buffer[i] << (8 * i);
+    return value;
+}
+
+
+
+/**
+ * Saves the game in progress into \c buffer, or only returns the size of the 
+ * snapshot if \c buffer is \c NULL.
+ *
+ * A snapshot holds a header with the field size, the move count, 
+ * \c field->time and the random number generator, the mine layout as encoded 
+ * by minesweeper_field_encode_mines(), a bitmap of the uncovered cells and 
+ * the flags at two bits per cell. Hints and openings are derived from the 
+ * mines on load, so a snapshot takes under 4 bits per cell.
+ *
+ * @return the number of bytes of the snapshot, or 0 if it doesn't fit in 
+ * \c size bytes
+ */
+size_t minesweeper_field_save(const MINESWEEPER_FIELD *field, uint8_t *buffer, size_t size) {
+    int cells = field->rows * field->cols;
+    size_t bitmaps = (cells + 7) / 8 + (cells + 3) / 4, mines = 0;
+    uint32_t density;
+
+    if (!buffer)
+        return MINESWEEPER_SAVE_HEADER + minesweeper_field_encode_mines(field, NULL, 0) + bitmaps;
+    if (size >= MINESWEEPER_SAVE_HEADER + bitmaps)
+        mines = minesweeper_field_encode_mines(field, buffer + MINESWEEPER_SAVE_HEADER, size - MINESWEEPER_SAVE_HEADER - bitmaps);
+    size_t total = MINESWEEPER_SAVE_HEADER + mines + bitmaps;
+    if (mines == 0)
+        return 0;
+
+    memset(buffer, 0, MINESWEEPER_SAVE_HEADER);
+    memcpy(buffer, MINESWEEPER_SAVE_MAGIC, 8);
+    memcpy(&density, &field->density, sizeof(density));
+    minesweeper_save_put(buffer + 8, MINESWEEPER_SAVE_VERSION, 4);
+    minesweeper_save_put(buffer + MINESWEEPER_SAVE_ROWS, field->rows, 4);
+    minesweeper_save_put(buffer + MINESWEEPER_SAVE_COLS, field->cols, 4);
+    minesweeper_save_put(buffer + MINESWEEPER_SAVE_MOVES, field->move_count, 4);
+    minesweeper_save_put(buffer + MINESWEEPER_SAVE_MINES, mines, 4);
+    uint64_t time;
+    memcpy(&time, &field->time, sizeof(time));
+    minesweeper_save_put(buffer + MINESWEEPER_SAVE_TIME, time, 8);
+    for (int i = 0; i < 4; i++)
+        minesweeper_save_put(buffer + MINESWEEPER_SAVE_RNG + 8 * i, field->rng.s[i], 8);
+    minesweeper_save_put(buffer + MINESWEEPER_SAVE_SEED, field->seed, 8);
+    minesweeper_save_put(buffer + MINESWEEPER_SAVE_DENSITY, density, 4);
+
+// Uncovered cells and flags, least significant bits first
+    uint8_t *state = buffer + MINESWEEPER_SAVE_HEADER + mines, *flags = state + (cells + 7) / 8;
+    memset(state, 0, (cells + 7) / 8 + (cells + 3) / 4);
+    for (int row = 0, cell = 0; row < field->rows; row++)
+        for (int col = 0; col < field->cols; col++, cell++) {
+            state[cell >> 3] |= minesweeper_cell_uncovered(field, row, col) << (cell & 7);
+            flags[cell >> 2] |= minesweeper_cell_flag(field, row, col) << ((cell & 3) << 1);
+        }
+
+    minesweeper_save_put(buffer + MINESWEEPER_SAVE_CHECKSUM, minesweeper_crc32(buffer + MINESWEEPER_SAVE_CHECKSUM + 4, total - MINESWEEPER_SAVE_CHECKSUM - 4), 4);
+
+    return total;
+}
+
+
+
+/**
+ * Restores a game saved by minesweeper_field_save(), resizing the field as 
+ * needed. The field is left untouched if the snapshot is truncated, corrupt 
+ * or from another version.
+ *
+ * @return \c true on success
+ */
+bool minesweeper_field_load(MINESWEEPER_FIELD *field, const uint8_t *buffer, size_t size) {
+    if (size < MINESWEEPER_SAVE_HEADER || memcmp(buffer, MINESWEEPER_SAVE_MAGIC, 8) != 0) return false;
+    if (minesweeper_save_get(buffer + 8, 4) != MINESWEEPER_SAVE_VERSION) return false;
+
+// Sizes are 32-bit, so their product can't overflow before it's checked
+    uint64_t saved_rows = minesweeper_save_get(buffer + MINESWEEPER_SAVE_ROWS, 4);
+    uint64_t saved_cols = minesweeper_save_get(buffer + MINESWEEPER_SAVE_COLS, 4);
+    uint64_t mines = minesweeper_save_get(buffer + MINESWEEPER_SAVE_MINES, 4);
+    if (saved_rows < 10 || saved_cols < 10 || saved_rows * saved_cols > INT_MAX / 2) return false;
+    int rows = saved_rows, cols = saved_cols, cells = rows * cols;
+    if (size != MINESWEEPER_SAVE_HEADER + mines + (cells + 7) / 8 + (cells + 3) / 4) return false;
+    if (minesweeper_save_get(buffer + MINESWEEPER_SAVE_CHECKSUM, 4) != minesweeper_crc32(buffer + MINESWEEPER_SAVE_CHECKSUM + 4, size - MINESWEEPER_SAVE_CHECKSUM - 4))
+        return false;
+    if (!minesweeper_codec_valid(cells, buffer + MINESWEEPER_SAVE_HEADER, mines)) return false;
+
+// Nothing can fail from here on
+    if (rows != field->rows || cols != field->cols)
+        minesweeper_field_allocate(field, rows, cols);
+    minesweeper_field_decode_mines(field, buffer + MINESWEEPER_SAVE_HEADER, mines, true);
+
+    const uint8_t *state = buffer + MINESWEEPER_SAVE_HEADER + mines, *flags = state + (cells + 7) / 8;
+    for (int row = 0, cell = 0; row < field->rows; row++)
+        for (int col = 0; col < field->cols; col++, cell++) {
+            int flag = (flags[cell >> 2] >> ((cell & 3) << 1)) & 3;
+            if ((state[cell >> 3] >> (cell & 7)) & 1) {
+                minesweeper_cell_set_uncovered(field, row, col, true);
+                field->cell_count--;
+            }
+            else if (flag == MINESWEEPER_DANGER || flag == MINESWEEPER_WARNING) {
+                minesweeper_cell_set_flag(field, row, col, flag);
+                field->flags_count += flag == MINESWEEPER_DANGER;
+            }
+        }
+
+    uint64_t time = minesweeper_save_get(buffer + MINESWEEPER_SAVE_TIME, 8);
+    uint32_t density = minesweeper_save_get(buffer + MINESWEEPER_SAVE_DENSITY, 4);
+    memcpy(&field->time, &time, sizeof(time));
+    memcpy(&field->density, &density, sizeof(density));
+    for (int i = 0; i < 4; i++)
+        field->rng.s[i] = minesweeper_save_get(buffer + MINESWEEPER_SAVE_RNG + 8 * i, 8);
+    field->seed = minesweeper_save_get(buffer + MINESWEEPER_SAVE_SEED, 8);
+    field->move_count = minesweeper_save_get(buffer + MINESWEEPER_SAVE_MOVES, 4);
+    field->complete = field->cell_count <= field->mine_count;
+
+    return true;
+}
+
+
+
+/**
+ * Returns a size that fits any snapshot of the field as it is now or after 
+ * any number of moves, without encoding it like minesweeper_field_save() 
+ * does, so a buffer for the snapshots of a game can be allocated once.
+ */
+size_t minesweeper_field_save_bound(const MINESWEEPER_FIELD *field) {
+// Mine layouts take at most a bit per cell plus the count of every segment
+    int cells = field->rows * field->cols, segments = (cells + MINESWEEPER_CODEC_SEGMENT - 1) / MINESWEEPER_CODEC_SEGMENT;
+
+    return MINESWEEPER_SAVE_HEADER + (cells + 7) / 8 + 2 * segments + 1 + (cells + 7) / 8 + (cells + 3) / 4;
+}
+
+
+
+/**
+ * Writes a snapshot taken by minesweeper_field_save() to the file at 
+ * \c path. The snapshot is written to a temporary file first and then 
+ * renamed over \c path, so a crash while saving leaves the previous snapshot 
+ * in place. Doesn't need the field, so it can run on another thread while 
+ * the game goes on.
+ *
+ * @return \c true on success
+ */
+bool minesweeper_save_write_file(const char *path, const uint8_t *buffer, size_t size) {
+    char *temporary = malloc(strlen(path) + 5);
+    assert(temporary);
+
+    sprintf(temporary, "%s.tmp", path);
+    FILE *file = fopen(temporary, "wb");
+    bool saved = file && fwrite(buffer, 1, size, file) == size;
+    saved = file && fclose(file) == 0 && saved;
+#ifdef _WIN32
+    if (saved)
+        remove(path);
+#endif
+    saved = saved && rename(temporary, path) == 0;
+    if (!saved)
+        remove(temporary);
+
+    free(temporary);
+    return saved;
+}
+
+
+
+/**
+ * Saves the game in progress to the file at \c path, see 
+ * minesweeper_save_write_file().
+ *
+ * @return \c true on success
+ */
+bool minesweeper_field_save_file(const MINESWEEPER_FIELD *field, const char *path) {
+    size_t size = minesweeper_field_save_bound(field);
+    uint8_t *buffer = malloc(size);
+    assert(buffer);
+
+    size = minesweeper_field_save(field, buffer, size);
+    assert(size > 0);
+    bool saved = minesweeper_save_write_file(path, buffer, size);
+
+    free(buffer);
+    return saved;
+}
+
+
+
+/**
+ * Restores the game saved in the file at \c path with 
+ * minesweeper_field_load(). Where available the file is memory-mapped, so 
+ * the snapshot is decoded straight from the page cache without copying it.
+ *
+ * @return \c true on success
+ */
+bool minesweeper_field_load_file(MINESWEEPER_FIELD *field, const char *path) {
+    bool loaded = false;
+
+#ifdef MINESWEEPER_MMAP
+    struct stat info;
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0) return false;
+    if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+        void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (map != MAP_FAILED) {
+            loaded = minesweeper_field_load(field, map, info.st_size);
+            munmap(map, info.st_size);
+        }
+    }
+    close(descriptor);
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        uint8_t *buffer = size > 0 ? malloc(size) : NULL;
+        rewind(file);
+        if (buffer && fread(buffer, 1, size, file) == size)
+            loaded = minesweeper_field_load(field, buffer, size);
+        free(buffer);
+    }
+    fclose(file);
+#endif
+
+    return loaded;
+}
+
+
+
 void minesweeper_field_destroy(MINESWEEPER_FIELD *field) {
-    free(field->cells);
-    free(field->hints);
-    free(field->state);
-    free(field->flags);
+    free(field->arena);
+    free(field->opening_arena);
+    free(field->opening_cells);
     free(field);
 }
 
 
 
+/**
+ * Uncovers the neighbors of the cell defined by \c row and \c col, cascading 
+ * through every zero-hint cell found along the way.
+ *
+ * This is an iterative breadth-first flood fill over \c field->queue. A cell 
+ * is pushed to the queue exactly once, at the moment it's uncovered, so the 
+ * queue never holds more than \c rows * \c cols entries and no cell's 
+ * neighborhood is scanned twice. Only zero-hint cells are expanded when popped.
+ * When the function returns, the first \c field->queue_count entries of the 
+ * queue are the (row-major) indices of the uncovered cells, starting with 
+ * (row, col) itself.
+ */
 void minesweeper_field_uncover(MINESWEEPER_FIELD *field, int row, int col) {
-    bool (*cells)[field->cols] = (bool (*)[])field->cells;
-    int (*hints)[field->cols] = (int (*)[])field->hints;
-    bool (*state)[field->cols] = (bool (*)[])field->state;
-    int (*flags)[field->cols] = (int (*)[])field->flags;
+    int *queue = field->queue;
+    int head = 0, tail = 0;
 
+    field->queue_count = 0;
     if (row < 0 || row >= field->rows) return;
     if (col < 0 || col >= field->cols) return;
 
-    for (int j = row - 1; j <= row + 1; j++) {
-        if (j < 0 || j >= field->rows) continue;
-        for (int i = col - 1; i <= col + 1; i++) {
-            if (i < 0 || i >= field->cols || state[j][i] || flags[j][i]) continue;
-            if (!cells[j][i] && !flags[j][i]) {
-                state[j][i] = true;
+    if (!minesweeper_cell_uncovered(field, row, col) && !minesweeper_cell_flag(field, row, col) && !minesweeper_cell_mine(field, row, col)) {
+        minesweeper_cell_set_uncovered(field, row, col, true);
+        field->cell_count--;
+    }
+    queue[tail++] = row * field->cols + col;
+
+    while (head < tail) {
+        int index = queue[head++];
+        row = index / field->cols;
+        col = index % field->cols;
+        if (head > 1 && minesweeper_cell_hint(field, row, col) != 0) continue;
+        for (int j = row - 1; j <= row + 1; j++) {
+            if (j < 0 || j >= field->rows) continue;
+            for (int i = col - 1; i <= col + 1; i++) {
+                if (i < 0 || i >= field->cols) continue;
+                if (minesweeper_cell_uncovered(field, j, i) || minesweeper_cell_flag(field, j, i) || minesweeper_cell_mine(field, j, i)) continue;
+                minesweeper_cell_set_uncovered(field, j, i, true);
                 field->cell_count--;
+                queue[tail++] = j * field->cols + i;
             }
-            if (hints[j][i] == 0)
-                minesweeper_field_uncover(field, j, i);
         }
     }
+    field->queue_count = tail;
+}
+
+
+
+/*
+ * Uncovers the whole opening of the zero-hint cell (row, col) from its 
+ * precomputed list, leaving the uncovered cells in \c field->queue like 
+ * minesweeper_field_uncover() does. That's only the same as the flood fill 
+ * while none of the zero-hint cells of the opening is uncovered or flagged, 
+ * so it returns \c false without changing anything otherwise. Border cells 
+ * may already be uncovered, by a neighboring opening for instance.
+ */
+static bool minesweeper_field_reveal_opening(MINESWEEPER_FIELD *field, int row, int col) {
+// Labelling the board costs more than the flood fill of a single opening, so 
+// it's only worth it from the second move on
+    if (field->opening_count < 0 && field->move_count == 0) return false;
+    minesweeper_field_label_openings(field);
+    int cell = row * field->cols + col, opening = field->openings[cell];
+    const int *cells = field->opening_cells + field->opening_start[opening];
+    int count = field->opening_start[opening + 1] - field->opening_start[opening];
+    int *queue = field->queue, tail = 1;
+
+    for (int k = 0; k < count; k++) {
+        int j = cells[k] / field->cols, i = cells[k] % field->cols;
+        if (minesweeper_cell_hint(field, j, i) == 0 && (minesweeper_cell_uncovered(field, j, i) || minesweeper_cell_flag(field, j, i))) return false;
+    }
+
+    queue[0] = cell;
+    minesweeper_cell_set_uncovered(field, row, col, true);
+    for (int k = 0; k < count; k++) {
+        int j = cells[k] / field->cols, i = cells[k] % field->cols;
+        if (minesweeper_cell_uncovered(field, j, i) || minesweeper_cell_flag(field, j, i)) continue;
+        minesweeper_cell_set_uncovered(field, j, i, true);
+        queue[tail++] = cells[k];
+    }
+    field->cell_count -= tail;
+    field->queue_count = tail;
+
+    return true;
+}
+
+
+
+/*
+ * Appends cells to a change list, growing its buffer when needed.
+ */
+static void minesweeper_changes_append(MINESWEEPER_CHANGES *changes, const int *cells, int count) {
+    if (changes->count + count > changes->capacity) {
+        int capacity = changes->capacity ? changes->capacity : 64;
+        while (capacity < changes->count + count)
+            capacity *= 2;
+        changes->cells = realloc(changes->cells, capacity * sizeof(int));
+        assert(changes->cells);
+        changes->capacity = capacity;
+    }
+    memcpy(changes->cells + changes->count, cells, count * sizeof(int));
+    changes->count += count;
 }
 
 
 
 /**
  * Uncovers the cell defined by \c row and \c col and its neighboring cells, if applicable.
+ * The cells uncovered by the move are left in \c field->queue and appended to
+ * \c field->changes, if set.
  *
  * @return \c true on success, \c false if a mine was found
  */
 bool minesweeper_event_uncover(MINESWEEPER_FIELD *field, int row, int col) {
-    bool (*cells)[field->cols] = (bool (*)[])field->cells;
-    int (*hints)[field->cols] = (int (*)[])field->hints;
-    bool (*state)[field->cols] = (bool (*)[])field->state;
-    int (*flags)[field->cols] = (int (*)[])field->flags;
-
+    field->queue_count = 0;
     if (row < 0 || row >= field->rows) return true;
     if (col < 0 || col >= field->cols) return true;
-    if (flags[row][col] != 0 || state[row][col]) return true;
-    if (cells[row][col]) return false;     // You lose
-    state[row][col] = true;
-    field->cell_count--;
-    if (hints[row][col] == 0)
+    if (minesweeper_cell_flag(field, row, col) != 0 || minesweeper_cell_uncovered(field, row, col)) return true;
+    if (minesweeper_cell_mine(field, row, col)) return false;     // You lose
+    if (minesweeper_cell_hint(field, row, col) != 0) {
+        minesweeper_cell_set_uncovered(field, row, col, true);
+        field->cell_count--;
+        field->queue[0] = row * field->cols + col;
+        field->queue_count = 1;
+    }
+    else if (!minesweeper_field_reveal_opening(field, row, col)) {
+        minesweeper_cell_set_uncovered(field, row, col, true);
+        field->cell_count--;
         minesweeper_field_uncover(field, row, col);
+    }
     if (field->cell_count <= field->mine_count)
         field->complete = true;
     field->move_count++;
+    if (field->changes)
+        minesweeper_changes_append(field->changes, field->queue, field->queue_count);
 
     return true;
 }
@@ -197,21 +1481,91 @@ bool minesweeper_event_uncover(MINESWEEPER_FIELD *field, int row, int col) {
 
 
 /**
- * Toggles the flags in the cell defined by \c row and \c col.
+ * Toggles the flags in the cell defined by \c row and \c col. The cell is
+ * appended to \c field->changes, if set.
  */
 void minesweeper_event_flag(MINESWEEPER_FIELD *field, int row, int col) {
-    int (*flags)[field->cols] = (int (*)[])field->flags;
-    bool (*state)[field->cols] = (bool (*)[])field->state;
-
     if (row < 0 || row >= field->rows) return;
     if (col < 0 || col >= field->cols) return;
-    if (!state[row][col]) {
-        flags[row][col] = (flags[row][col] + 1) % 3;
-        if (flags[row][col] == MINESWEEPER_DANGER)
+    if (!minesweeper_cell_uncovered(field, row, col)) {
+        int flag = (minesweeper_cell_flag(field, row, col) + 1) % 3;
+        minesweeper_cell_set_flag(field, row, col, flag);
+        if (flag == MINESWEEPER_DANGER)
             field->flags_count++;
-        else if (flags[row][col] == MINESWEEPER_WARNING)
+        else if (flag == MINESWEEPER_WARNING)
             field->flags_count--;
+        if (field->changes) {
+            int cell = row * field->cols + col;
+            minesweeper_changes_append(field->changes, &cell, 1);
+        }
+    }
+}
+
+
+
+MINESWEEPER_CHANGES *minesweeper_changes_create() {
+    MINESWEEPER_CHANGES *changes = calloc(1, sizeof(MINESWEEPER_CHANGES));
+    assert(changes);
+
+    return changes;
+}
+
+
+
+void minesweeper_changes_destroy(MINESWEEPER_CHANGES *changes) {
+    free(changes->cells);
+    free(changes->runs);
+    free(changes);
+}
+
+
+
+/**
+ * Empties the list, keeping its buffers for the next events.
+ */
+void minesweeper_changes_clear(MINESWEEPER_CHANGES *changes) {
+    changes->count = 0;
+    changes->run_count = 0;
+}
+
+
+
+static int minesweeper_changes_order(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+
+/**
+ * Sorts the changed cells, drops duplicates (a cell flagged several times,
+ * for instance) and stores them as runs of consecutive cells in \c runs.
+ * Runs may span several rows. \c cells is left sorted and deduplicated.
+ */
+void minesweeper_changes_compact(MINESWEEPER_CHANGES *changes) {
+    int count = 0;
+
+    qsort(changes->cells, changes->count, sizeof(int), minesweeper_changes_order);
+    changes->run_count = 0;
+    for (int i = 0; i < changes->count; i++) {
+        int cell = changes->cells[i];
+        if (count > 0 && changes->cells[count - 1] == cell) continue;
+        changes->cells[count++] = cell;
+        if (changes->run_count > 0 && changes->runs[2 * changes->run_count - 2] + changes->runs[2 * changes->run_count - 1] == cell) {
+            changes->runs[2 * changes->run_count - 1]++;
+            continue;
+        }
+        if (changes->run_count == changes->run_capacity) {
+            changes->run_capacity = changes->run_capacity ? changes->run_capacity * 2 : 64;
+            changes->runs = realloc(changes->runs, 2 * changes->run_capacity * sizeof(int));
+            assert(changes->runs);
+        }
+        changes->runs[2 * changes->run_count] = cell;
+        changes->runs[2 * changes->run_count + 1] = 1;
+        changes->run_count++;
     }
+    changes->count = count;
 }
 
 
@@ -0,0 +1,308 @@
+/**
+ * @file monstrominas_gen.c
+ *
+ * @section LICENSE License
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <https://unlicense.org>
+ *
+ * @section DESCRIPTION Description
+ *
+ * Generates batches of boards outside the game, using every core:
+ *
+ *     monstrominas-gen [-n boards] [-r rows] [-c cols] [-d density]
+ *                      [-s first_seed] [-m row,col] [-t threads] output
+ *
+ * Board \c i is generated with seed <tt>first_seed + i</tt> and the first move
+ * at (row, col), the center by default, so any board can be regenerated on
+ * its own and the file doesn't depend on the number of threads. A density of
+ * 0 uses the game's default for the board size.
+ *
+ * The output starts with a 48-byte header, all numbers little-endian:
+ *
+ *     magic "MONSTROM", u32 version, u32 rows, u32 cols, u32 first move row,
+ *     u32 first move col, f32 density, u64 first seed, u64 boards
+ *
+ * followed by one fixed-size record per board, in seed order:
+ *
+ *     u64 seed, u32 mines, u32 3BV, mines bitmap
+ *
+ * The bitmap holds one bit per cell in row-major order, cell \c i being bit
+ * <tt>i % 8</tt> of byte <tt>i / 8</tt>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "monstrominas.h"
+#include "analysis.h"
+
+
+
+#define GEN_VERSION         1
+#define GEN_HEADER_SIZE     48
+#define GEN_RECORD_HEADER   16
+#define GEN_CHUNK_BYTES     (4 << 20)   // Boards are written in chunks of about this size
+#define GEN_MAX_THREADS     64
+#define GEN_MAX_SIZE        10000
+
+
+
+/*
+ * Generation state shared by the worker threads. Workers take chunks of
+ * consecutive boards in order, generate them into a private buffer and then
+ * wait for the previous chunks to be written before writing their own.
+ */
+typedef struct GEN_JOB {
+    FILE *file;
+    int rows;
+    int cols;
+    int row;
+    int col;
+    float density;
+    uint64_t seed;
+    long count;
+    size_t record_size;
+    long chunk_boards;
+    long chunk_count;
+    long next_chunk;
+    long written_chunks;
+    bool failed;
+    pthread_mutex_t mutex;
+    pthread_cond_t written;
+} GEN_JOB;
+
+
+
+static double gen_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+
+static void gen_put32(uint8_t *buffer, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        buffer[i] = value >> (8 * i);
+}
+
+
+
+static void gen_put64(uint8_t *buffer, uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        buffer[i] = value >> (8 * i);
+}
+
+
+
+static void gen_pack_mines(const MINESWEEPER_FIELD *field, uint8_t *bitmap) {
+    int cell = 0;
+
+    memset(bitmap, 0, (field->rows * field->cols + 7) / 8);
+    for (int row = 0; row < field->rows; row++)
+        for (int col = 0; col < field->cols; col++, cell++)
+            if (minesweeper_cell_mine(field, row, col))
+                bitmap[cell >> 3] |= 1 << (cell & 7);
+}
+
+
+
+static void *gen_worker(void *data) {
+    GEN_JOB *job = data;
+    MINESWEEPER_FIELD *field = minesweeper_field_create_seeded(job->rows, job->cols, job->seed);
+    MINESWEEPER_METRICS metrics;
+    uint8_t *buffer = malloc(job->chunk_boards * job->record_size);
+    long chunk;
+
+    assert(buffer);
+    field->density = job->density;
+    while ((chunk = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED)) < job->chunk_count) {
+        long first = chunk * job->chunk_boards;
+        long boards = job->count - first < job->chunk_boards ? job->count - first : job->chunk_boards;
+
+        for (long i = 0; i < boards; i++) {
+            uint8_t *record = buffer + i * job->record_size;
+            uint64_t seed = job->seed + first + i;
+            minesweeper_field_seed(field, seed);
+            minesweeper_field_generate(field, job->row, job->col, true);
+            minesweeper_field_metrics(field, &metrics);
+            gen_put64(record, seed);
+            gen_put32(record + 8, field->mine_count);
+            gen_put32(record + 12, metrics.bbbv);
+            gen_pack_mines(field, record + GEN_RECORD_HEADER);
+        }
+
+        pthread_mutex_lock(&job->mutex);
+        while (job->written_chunks != chunk)
+            pthread_cond_wait(&job->written, &job->mutex);
+        if (fwrite(buffer, job->record_size, boards, job->file) != (size_t)boards)
+            job->failed = true;
+        job->written_chunks++;
+        pthread_cond_broadcast(&job->written);
+        pthread_mutex_unlock(&job->mutex);
+    }
+
+    free(buffer);
+    minesweeper_field_destroy(field);
+
+    return NULL;
+}
+
+
+
+static void gen_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n boards] [-r rows] [-c cols] [-d density] [-s first_seed] [-m row,col] [-t threads] output\n", name);
+    exit(EXIT_FAILURE);
+}
+
+
+
+/*
+ * Parses a decimal integer in [min, max] from \c text, which must hold 
+ * nothing else unless \c rest is given to receive the text that follows. 
+ * Exits with the usage message otherwise.
+ */
+static long gen_integer(const char *name, const char *text, char **rest, long min, long max) {
+    char *end;
+
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (end == text || errno == ERANGE || value < min || value > max || (!rest && *end != '\0'))
+        gen_usage(name);
+    if (rest) *rest = end;
+    return value;
+}
+
+
+
+int main(int argc, char **argv) {
+    GEN_JOB job = {
+        .rows = 16,
+        .cols = 30,
+        .row = -1,
+        .col = -1,
+        .count = 1000,
+    };
+    pthread_t threads[GEN_MAX_THREADS];
+    int thread_count = 1, option;
+    uint8_t header[GEN_HEADER_SIZE];
+    char *end;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    while ((option = getopt(argc, argv, "n:r:c:d:s:m:t:")) != -1) {
+        switch (option) {
+        // Boards are counted in chunks, which mustn't overflow either
+            case 'n': job.count = gen_integer(argv[0], optarg, NULL, 1, LONG_MAX - GEN_CHUNK_BYTES); break;
+            case 'r': job.rows = gen_integer(argv[0], optarg, NULL, 10, GEN_MAX_SIZE); break;
+            case 'c': job.cols = gen_integer(argv[0], optarg, NULL, 10, GEN_MAX_SIZE); break;
+            case 't': thread_count = gen_integer(argv[0], optarg, NULL, 1, GEN_MAX_THREADS); break;
+            case 'd': {
+                double density = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !(density >= 0 && density < 1)) gen_usage(argv[0]);
+                job.density = density;
+                break;
+            }
+            case 's':
+            // strtoull() would wrap negative seeds around
+                errno = 0;
+                job.seed = strtoull(optarg, &end, 0);
+                if (end == optarg || *end != '\0' || errno == ERANGE || strchr(optarg, '-')) gen_usage(argv[0]);
+                break;
+            case 'm':
+                job.row = gen_integer(argv[0], optarg, &end, 0, GEN_MAX_SIZE - 1);
+                if (*end != ',') gen_usage(argv[0]);
+                job.col = gen_integer(argv[0], end + 1, NULL, 0, GEN_MAX_SIZE - 1);
+                break;
+            default: gen_usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        gen_usage(argv[0]);
+    if (job.row < 0 && job.col < 0) {
+        job.row = job.rows / 2;
+        job.col = job.cols / 2;
+    }
+    if (job.row < 0 || job.row >= job.rows || job.col < 0 || job.col >= job.cols)
+        gen_usage(argv[0]);
+    thread_count = thread_count < 1 ? 1 : (thread_count > GEN_MAX_THREADS ? GEN_MAX_THREADS : thread_count);
+
+    job.file = fopen(argv[optind], "wb");
+    if (!job.file) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    job.record_size = GEN_RECORD_HEADER + ((size_t)job.rows * job.cols + 7) / 8;
+    job.chunk_boards = GEN_CHUNK_BYTES / job.record_size > 0 ? GEN_CHUNK_BYTES / job.record_size : 1;
+    job.chunk_count = (job.count + job.chunk_boards - 1) / job.chunk_boards;
+
+    uint32_t density;
+    memcpy(&density, &job.density, sizeof(density));
+    memcpy(header, "MONSTROM", 8);
+    gen_put32(header + 8, GEN_VERSION);
+    gen_put32(header + 12, job.rows);
+    gen_put32(header + 16, job.cols);
+    gen_put32(header + 20, job.row);
+    gen_put32(header + 24, job.col);
+    gen_put32(header + 28, density);
+    gen_put64(header + 32, job.seed);
+    gen_put64(header + 40, job.count);
+    job.failed = fwrite(header, GEN_HEADER_SIZE, 1, job.file) != 1;
+
+    double start = gen_now();
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.written, NULL);
+    for (int i = 1; i < thread_count; i++)
+        if (pthread_create(&threads[i], NULL, gen_worker, &job) != 0) {
+            thread_count = i;
+            break;
+        }
+    gen_worker(&job);
+    for (int i = 1; i < thread_count; i++)
+        pthread_join(threads[i], NULL);
+    pthread_cond_destroy(&job.written);
+    pthread_mutex_destroy(&job.mutex);
+    double elapsed = gen_now() - start;
+
+    if (fclose(job.file) != 0 || job.failed) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "%ld boards of %dx%d cells in %.2f s (%.0f boards/s, %d threads)\n",
+            job.count, job.rows, job.cols, elapsed, job.count / elapsed, thread_count);
+
+    return EXIT_SUCCESS;
+}
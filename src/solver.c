@@ -0,0 +1,422 @@
+/**
+ * @file solver.c
+ *
+ * @section LICENSE License
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * For more information, please refer to <https://unlicense.org>
+ *
+ * @section DESCRIPTION Description
+ *
+ * Constraint propagation solver. Every uncovered hint cell is a constraint:
+ * its covered neighbors hold exactly (hint - known mines) mines. The solver
+ * applies single-point deductions (all of them are safe, or all of them are
+ * mines) and pairwise deductions between overlapping constraints, and it does
+ * so incrementally: only the constraints around the cells that changed since
+ * the last update are examined again.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include "solver.h"
+
+
+
+/*
+ * Unknown neighbors of a constraint are kept as bit masks over the 7x7 window
+ * centered at the cell being examined, which is large enough to hold the
+ * neighbors of any constraint up to two cells away from it.
+ */
+#define SOLVER_WINDOW_BIT(drow, dcol)   (UINT64_C(1) << (((drow) + 3) * 7 + (dcol) + 3))
+
+
+
+static void minesweeper_solver_enqueue(MINESWEEPER_SOLVER *solver, int cell) {
+    int cells = solver->field->rows * solver->field->cols;
+
+    if (solver->queued[cell]) return;
+    solver->queued[cell] = true;
+    solver->work[(solver->work_head + solver->work_count++) % cells] = cell;
+}
+
+
+
+/*
+ * Queues the uncovered hint cells around (row, col), including the cell
+ * itself, since their constraints involve it.
+ */
+static void minesweeper_solver_touch(MINESWEEPER_SOLVER *solver, int row, int col) {
+    MINESWEEPER_FIELD *field = solver->field;
+
+    for (int j = row - 1; j <= row + 1; j++) {
+        if (j < 0 || j >= field->rows) continue;
+        for (int i = col - 1; i <= col + 1; i++) {
+            if (i < 0 || i >= field->cols) continue;
+            if (minesweeper_cell_uncovered(field, j, i) && minesweeper_cell_hint(field, j, i) > 0)
+                minesweeper_solver_enqueue(solver, j * field->cols + i);
+        }
+    }
+}
+
+
+
+static void minesweeper_solver_mark(MINESWEEPER_SOLVER *solver, int row, int col, int state) {
+    int cell = row * solver->field->cols + col;
+
+    if (solver->known[cell] != MINESWEEPER_SOLVER_UNKNOWN) return;
+    solver->known[cell] = state;
+    if (state == MINESWEEPER_SOLVER_SAFE)
+        solver->safe[solver->safe_count++] = cell;
+    else
+        solver->mines[solver->mine_count++] = cell;
+    minesweeper_solver_touch(solver, row, col);
+}
+
+
+
+/*
+ * Marks every cell in the window mask around (row, col) with \c state.
+ */
+static void minesweeper_solver_mark_mask(MINESWEEPER_SOLVER *solver, int row, int col, uint64_t mask, int state) {
+    while (mask) {
+        int bit = __builtin_ctzll(mask);
+        mask &= mask - 1;
+        minesweeper_solver_mark(solver, row + bit / 7 - 3, col + bit % 7 - 3, state);
+    }
+}
+
+
+
+/*
+ * Returns the unknown covered neighbors of (row, col) as a mask over the
+ * window centered at (center_row, center_col) and stores in \c remaining how
+ * many of them are mines.
+ */
+static uint64_t minesweeper_solver_constraint(MINESWEEPER_SOLVER *solver, int row, int col, int center_row, int center_col, int *remaining) {
+    MINESWEEPER_FIELD *field = solver->field;
+    uint64_t mask = 0;
+    int mines = minesweeper_cell_hint(field, row, col);
+
+    for (int j = row - 1; j <= row + 1; j++) {
+        if (j < 0 || j >= field->rows) continue;
+        for (int i = col - 1; i <= col + 1; i++) {
+            if (i < 0 || i >= field->cols || minesweeper_cell_uncovered(field, j, i)) continue;
+            int known = solver->known[j * field->cols + i];
+            if (known == MINESWEEPER_SOLVER_MINE)
+                mines--;
+            else if (known == MINESWEEPER_SOLVER_UNKNOWN)
+                mask |= SOLVER_WINDOW_BIT(j - center_row, i - center_col);
+        }
+    }
+    *remaining = mines;
+
+    return mask;
+}
+
+
+
+/*
+ * Examines the constraint of an uncovered hint cell, first on its own and then
+ * against every constraint that shares unknown cells with it. If x and y are
+ * two such constraints, A and B their unknown cells that the other one doesn't
+ * see, then mines(A) - mines(B) = remaining(x) - remaining(y); when that
+ * equals |A|, every cell in A is a mine and every cell in B is safe.
+ */
+static void minesweeper_solver_examine(MINESWEEPER_SOLVER *solver, int cell) {
+    MINESWEEPER_FIELD *field = solver->field;
+    int row = cell / field->cols, col = cell % field->cols;
+    int remaining, other_remaining;
+
+    uint64_t unknown = minesweeper_solver_constraint(solver, row, col, row, col, &remaining);
+    if (!unknown) return;
+    int count = __builtin_popcountll(unknown);
+    if (remaining == 0) {
+        minesweeper_solver_mark_mask(solver, row, col, unknown, MINESWEEPER_SOLVER_SAFE);
+        return;
+    }
+    if (remaining == count) {
+        minesweeper_solver_mark_mask(solver, row, col, unknown, MINESWEEPER_SOLVER_MINE);
+        return;
+    }
+
+    for (int j = row - 2; j <= row + 2; j++) {
+        if (j < 0 || j >= field->rows) continue;
+        for (int i = col - 2; i <= col + 2; i++) {
+            if (i < 0 || i >= field->cols || (j == row && i == col)) continue;
+            if (!minesweeper_cell_uncovered(field, j, i) || minesweeper_cell_hint(field, j, i) == 0) continue;
+
+            uint64_t other = minesweeper_solver_constraint(solver, j, i, row, col, &other_remaining);
+            if (!(other & unknown)) continue;
+            uint64_t only_this = unknown & ~other, only_other = other & ~unknown;
+            if (!(only_this | only_other)) continue;
+            if (remaining - other_remaining == __builtin_popcountll(only_this)) {
+                minesweeper_solver_mark_mask(solver, row, col, only_this, MINESWEEPER_SOLVER_MINE);
+                minesweeper_solver_mark_mask(solver, row, col, only_other, MINESWEEPER_SOLVER_SAFE);
+                return;
+            }
+            if (other_remaining - remaining == __builtin_popcountll(only_other)) {
+                minesweeper_solver_mark_mask(solver, row, col, only_other, MINESWEEPER_SOLVER_MINE);
+                minesweeper_solver_mark_mask(solver, row, col, only_this, MINESWEEPER_SOLVER_SAFE);
+                return;
+            }
+        }
+    }
+}
+
+
+
+MINESWEEPER_SOLVER *minesweeper_solver_create(MINESWEEPER_FIELD *field) {
+    MINESWEEPER_SOLVER *solver = calloc(sizeof(MINESWEEPER_SOLVER), 1);
+    assert(solver);
+    solver->field = field;
+    minesweeper_solver_reset(solver);
+
+    return solver;
+}
+
+
+
+void minesweeper_solver_destroy(MINESWEEPER_SOLVER *solver) {
+    free(solver->arena);
+    free(solver);
+}
+
+
+
+/**
+ * Forgets every deduction. Call it after the field is reset or resized; the
+ * solver's buffers are only reallocated if the field grew past them.
+ */
+void minesweeper_solver_reset(MINESWEEPER_SOLVER *solver) {
+    size_t cells = (size_t)solver->field->rows * solver->field->cols;
+    size_t size = cells * (2 * sizeof(uint8_t) + 3 * sizeof(int));
+
+    if (size > solver->arena_size) {
+        free(solver->arena);
+        solver->arena = malloc(size);
+        assert(solver->arena);
+        solver->arena_size = size;
+    }
+    solver->work = solver->arena;
+    solver->safe = solver->work + cells;
+    solver->mines = solver->safe + cells;
+    solver->known = (uint8_t *)(solver->mines + cells);
+    solver->queued = solver->known + cells;
+    memset(solver->known, MINESWEEPER_SOLVER_UNKNOWN, cells);
+    memset(solver->queued, false, cells);
+    solver->work_head = solver->work_count = 0;
+    solver->safe_count = solver->safe_next = 0;
+    solver->mine_count = 0;
+}
+
+
+
+/**
+ * Updates the deductions after the cells in \c cells (row-major indices) have
+ * been uncovered, e.g. with the \c field->queue list left by
+ * minesweeper_event_uncover(). Only the constraints around those cells, and
+ * the ones affected by the resulting deductions, are examined.
+ */
+void minesweeper_solver_update(MINESWEEPER_SOLVER *solver, const int *cells, int count) {
+    MINESWEEPER_FIELD *field = solver->field;
+    int total = field->rows * field->cols;
+
+    for (int k = 0; k < count; k++) {
+        if (solver->known[cells[k]] == MINESWEEPER_SOLVER_UNKNOWN)
+            solver->known[cells[k]] = MINESWEEPER_SOLVER_SAFE;
+        minesweeper_solver_touch(solver, cells[k] / field->cols, cells[k] % field->cols);
+    }
+
+    while (solver->work_count > 0) {
+        int cell = solver->work[solver->work_head];
+        solver->work_head = (solver->work_head + 1) % total;
+        solver->work_count--;
+        solver->queued[cell] = false;
+        minesweeper_solver_examine(solver, cell);
+    }
+}
+
+
+
+/**
+ * Returns, in \c row and \c col, a covered cell that is certainly safe.
+ *
+ * @return \c false if no such cell is known
+ */
+bool minesweeper_solver_next_safe(MINESWEEPER_SOLVER *solver, int *row, int *col) {
+    MINESWEEPER_FIELD *field = solver->field;
+
+    while (solver->safe_next < solver->safe_count) {
+        int cell = solver->safe[solver->safe_next++];
+        if (minesweeper_cell_uncovered(field, cell / field->cols, cell % field->cols)) continue;
+        *row = cell / field->cols;
+        *col = cell % field->cols;
+        return true;
+    }
+
+    return false;
+}
+
+
+
+
+/**
+ * Plays a freshly reset field from the first move at (row, col) using only
+ * the solver's certain deductions.
+ *
+ * @return \c true if the whole field was cleared without guessing
+ */
+bool minesweeper_solver_play(MINESWEEPER_SOLVER *solver, int row, int col) {
+    MINESWEEPER_FIELD *field = solver->field;
+
+    minesweeper_solver_reset(solver);
+    if (!minesweeper_event_uncover(field, row, col)) return false;
+    minesweeper_solver_update(solver, field->queue, field->queue_count);
+    while (!field->complete && minesweeper_solver_next_safe(solver, &row, &col)) {
+        minesweeper_event_uncover(field, row, col);
+        minesweeper_solver_update(solver, field->queue, field->queue_count);
+    }
+
+    return field->complete;
+}
+
+
+
+/*
+ * No-guess generation state shared by the threads racing candidate layouts.
+ */
+typedef struct SOLVER_RACE {
+    MINESWEEPER_FIELD *field;
+    int row;
+    int col;
+    bool reset_flags;
+    int attempts;
+    int max_attempts;
+    double deadline;        // CLOCK_MONOTONIC seconds, 0 for no time limit
+    bool found;
+    pthread_mutex_t mutex;
+} SOLVER_RACE;
+
+typedef struct SOLVER_RACER {
+    SOLVER_RACE *race;
+    MINESWEEPER_FIELD *field;
+    MINESWEEPER_SOLVER *solver;
+    pthread_t thread;
+} SOLVER_RACER;
+
+
+
+static double minesweeper_solver_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+
+static void *minesweeper_solver_race(void *data) {
+    SOLVER_RACER *racer = data;
+    SOLVER_RACE *race = racer->race;
+
+    while (!__atomic_load_n(&race->found, __ATOMIC_ACQUIRE) && __atomic_fetch_add(&race->attempts, 1, __ATOMIC_RELAXED) < race->max_attempts) {
+        if (race->deadline && minesweeper_solver_clock() > race->deadline) break;
+        minesweeper_field_generate(racer->field, race->row, race->col, true);
+        if (!minesweeper_solver_play(racer->solver, race->row, race->col)) continue;
+
+        pthread_mutex_lock(&race->mutex);
+        if (!race->found) {
+            minesweeper_field_copy_mines(race->field, racer->field, race->reset_flags);
+            __atomic_store_n(&race->found, true, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&race->mutex);
+    }
+
+    return NULL;
+}
+
+
+
+/**
+ * Resets a field like minesweeper_field_reset() but only accepts layouts the 
+ * solver can clear from the first move at (row, col) without guessing.
+ *
+ * Candidate layouts are generated and played by \c threads threads, each on a 
+ * private field seeded from the field's generator, until one of them finds a 
+ * solvable layout, \c max_attempts layouts have been tried or \c max_seconds 
+ * have passed (no time limit if it's not positive). The time is only checked 
+ * between attempts, so the limit may be exceeded by one attempt, around half 
+ * a second for a million cells. With a single thread the result only depends 
+ * on the field's seed; with more, on which thread wins the race.
+ *
+ * @return \c true on success, \c false if no layout was found or (row, col) 
+ * is outside the field, in which case the field gets a regular reset
+ */
+bool minesweeper_field_reset_noguess(MINESWEEPER_FIELD *field, int row, int col, bool reset_flags, int threads, int max_attempts, double max_seconds) {
+    if (row < 0 || row >= field->rows || col < 0 || col >= field->cols) {
+        minesweeper_field_generate(field, row, col, reset_flags);
+        return false;
+    }
+
+    SOLVER_RACE race = {
+        .field = field,
+        .row = row,
+        .col = col,
+        .reset_flags = reset_flags,
+        .max_attempts = max_attempts,
+        .deadline = max_seconds > 0 ? minesweeper_solver_clock() + max_seconds : 0,
+    };
+    SOLVER_RACER racers[MINESWEEPER_SOLVER_MAX_THREADS];
+
+    threads = threads < 1 ? 1 : (threads > MINESWEEPER_SOLVER_MAX_THREADS ? MINESWEEPER_SOLVER_MAX_THREADS : threads);
+    for (int i = 0; i < threads; i++) {
+        racers[i].race = &race;
+        racers[i].field = minesweeper_field_create_seeded(field->rows, field->cols, field->rng.next(&field->rng));
+        racers[i].field->density = field->density;
+        racers[i].solver = minesweeper_solver_create(racers[i].field);
+    }
+
+    pthread_mutex_init(&race.mutex, NULL);
+    int started = 1;
+    while (started < threads && pthread_create(&racers[started].thread, NULL, minesweeper_solver_race, &racers[started]) == 0)
+        started++;
+    minesweeper_solver_race(&racers[0]);
+    for (int i = 1; i < started; i++)
+        pthread_join(racers[i].thread, NULL);
+    pthread_mutex_destroy(&race.mutex);
+
+    for (int i = 0; i < threads; i++) {
+        minesweeper_solver_destroy(racers[i].solver);
+        minesweeper_field_destroy(racers[i].field);
+    }
+
+    if (!race.found)
+        minesweeper_field_generate(field, row, col, reset_flags);
+
+    return race.found;
+}
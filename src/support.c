@@ -35,6 +35,53 @@
 
 #include <allegro5/allegro.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BMPUTILS_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define BMPUTILS_MAX_SIMD_RADIUS    2051    // Largest radius for which the fixed-point reciprocal is exact
+#define BMPUTILS_BLUR_BLOCK           16    // Rows per block, 16 RGBA pixels fill a 64 byte cache line
+#define BMPUTILS_MAX_THREADS           8
+#define BMPUTILS_MIN_THREAD_PIXELS 16384    // Smaller shares of a blur aren't worth waking a thread for
+#define BMPUTILS_FAST_BLUR_RADIUS      4    // Blur radius, in pixels of the downsampled bitmap, of bmputils_fast_blur()
+
+
+
+typedef void (*BMPUTILS_BLUR_ROWS)(const uint8_t *src, int src_pitch, uint8_t *dst, int dst_pitch, int w, int y1, int y2, int radius, uint32_t reciprocal);
+
+typedef struct {
+    BMPUTILS_BLUR_ROWS kernel;
+    const uint8_t *src;
+    uint8_t *dst;
+    int src_pitch, dst_pitch;
+    int w, y1, y2;
+    int radius;
+    uint32_t reciprocal;
+} BMPUTILS_BLUR_JOB;
+
+/*
+ * Worker threads for the blurs, started the first time a blur is split and 
+ * sleeping on \c work between blurs until the program exits. The thread that 
+ * posts the jobs runs them too, so there are at most BMPUTILS_MAX_THREADS - 1.
+ */
+typedef struct {
+    ALLEGRO_THREAD *threads[BMPUTILS_MAX_THREADS];
+    int thread_count;
+    ALLEGRO_MUTEX *mutex;
+    ALLEGRO_COND *work;                 // Signalled when jobs are posted
+    ALLEGRO_COND *done;                 // Signalled when the last job is finished
+    BMPUTILS_BLUR_JOB *jobs;
+    int job_count, next_job, pending;
+} BMPUTILS_POOL;
+
+static int bmputils_threads = 0;                    // See bmputils_set_threads()
+static BMPUTILS_POOL bmputils_pool;
 
 
 
@@ -44,19 +91,300 @@ static inline int utils_clampi(int x, int a, int b) {
 
 
 
+/*
+ * Scalar row kernel, blurs rows [y1, y2) of the source bitmap into columns
+ * of the destination bitmap. One running sum per channel, updated with the
+ * pixel entering and the pixel leaving the kernel window.
+ */
+static void bmputils_blur_rows(const uint8_t *src, int src_pitch, uint8_t *dst, int dst_pitch, int w, int y1, int y2, int radius, uint32_t reciprocal) {
+    int factor = radius * 2  + 1;
+
+    for (int y = y1; y < y2; y++) {
+        const int *ioffset = (const int *)(src + y * src_pitch);
+        int kr = 0, kg = 0, kb = 0, ka = 0;
+
+    // Get the initial horizontal kernel sum
+        for (int i = -radius; i <= radius; i++) {
+            int irgb = *(ioffset + utils_clampi(i, 0, w - 1));
+            kr += (irgb >> 24) & 0xFF;
+            kg += (irgb >> 16) & 0xFF;
+            kb += (irgb >> 8) & 0xFF;
+            ka += irgb & 0xFF;
+        }
+
+        for (int x = 0; x < w; x++) {
+            int i1, i2, rgb1, rgb2;
+
+            *((int *)(dst + x * dst_pitch) + y) = ((kr / factor) << 24) | ((kg / factor) << 16) | ((kb / factor) << 8) | (ka / factor);
+
+            i1 = (x + radius + 1 > w - 1) ? w - 1 : x + radius + 1;
+            i2 = (x - radius < 0) ? 0 : x - radius;
+            rgb1 = *(ioffset + i1);
+            rgb2 = *(ioffset + i2);
+            kr += ((rgb1 >> 24) & 0xff) - ((rgb2 >> 24) & 0xff);
+            kg += ((rgb1 & 0xff0000) - (rgb2 & 0xff0000)) >> 16;
+            kb += ((rgb1 & 0xff00) - (rgb2 & 0xff00)) >> 8;
+            ka += (rgb1 & 0xff) - (rgb2 & 0xff);
+        }
+    }
+}
+
+
+
+#ifdef BMPUTILS_X86
+/*
+ * SSE2 row kernel. The four channel sums of a pixel live in the four 32-bit
+ * lanes of a register and the division by the kernel size is a multiply by
+ * a 32.32 fixed-point reciprocal, which gives the same quotients as the
+ * scalar division for every radius up to BMPUTILS_MAX_SIMD_RADIUS.
+ */
+__attribute__((target("sse2")))
+static inline __m128i bmputils_unpack_sse2(uint32_t pixel) {
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixel), zero), zero);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i bmputils_divide_sse2(__m128i sum, __m128i reciprocal) {
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(sum, reciprocal), 32);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(sum, 32), reciprocal);
+    return _mm_or_si128(even, _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0)));
+}
+
+__attribute__((target("sse2")))
+static void bmputils_blur_rows_sse2(const uint8_t *src, int src_pitch, uint8_t *dst, int dst_pitch, int w, int y1, int y2, int radius, uint32_t reciprocal) {
+    __m128i mul = _mm_set1_epi32(reciprocal);
+
+    for (int y = y1; y < y2; y++) {
+        const uint32_t *in = (const uint32_t *)(src + y * src_pitch);
+        __m128i k = _mm_setzero_si128();
+
+        for (int i = -radius; i <= radius; i++)
+            k = _mm_add_epi32(k, bmputils_unpack_sse2(in[utils_clampi(i, 0, w - 1)]));
+        for (int x = 0; x < w; x++) {
+            __m128i q = bmputils_divide_sse2(k, mul);
+            q = _mm_packus_epi16(_mm_packs_epi32(q, q), q);
+            *((uint32_t *)(dst + x * dst_pitch) + y) = _mm_cvtsi128_si32(q);
+
+            int i1 = (x + radius + 1 > w - 1) ? w - 1 : x + radius + 1;
+            int i2 = (x - radius < 0) ? 0 : x - radius;
+            k = _mm_add_epi32(k, _mm_sub_epi32(bmputils_unpack_sse2(in[i1]), bmputils_unpack_sse2(in[i2])));
+        }
+    }
+}
+
+
+
+/*
+ * AVX2 row kernel, blurs two rows at once, one per 128-bit half, so that the
+ * two output pixels land next to each other in the transposed bitmap.
+ */
+__attribute__((target("avx2")))
+static inline __m256i bmputils_unpack_avx2(uint32_t pixel1, uint32_t pixel2) {
+    return _mm256_cvtepu8_epi32(_mm_unpacklo_epi32(_mm_cvtsi32_si128(pixel1), _mm_cvtsi32_si128(pixel2)));
+}
+
+__attribute__((target("avx2")))
+static void bmputils_blur_rows_avx2(const uint8_t *src, int src_pitch, uint8_t *dst, int dst_pitch, int w, int y1, int y2, int radius, uint32_t reciprocal) {
+    __m256i mul = _mm256_set1_epi32(reciprocal);
+    __m256i high = _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+    int y;
+
+    for (y = y1; y + 1 < y2; y += 2) {
+        const uint32_t *in1 = (const uint32_t *)(src + y * src_pitch);
+        const uint32_t *in2 = (const uint32_t *)(src + (y + 1) * src_pitch);
+        __m256i k = _mm256_setzero_si256();
+
+        for (int i = -radius; i <= radius; i++) {
+            int c = utils_clampi(i, 0, w - 1);
+            k = _mm256_add_epi32(k, bmputils_unpack_avx2(in1[c], in2[c]));
+        }
+        for (int x = 0; x < w; x++) {
+            __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(k, mul), 32);
+            __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(k, 32), mul);
+            __m256i q = _mm256_or_si256(even, _mm256_and_si256(odd, high));
+            q = _mm256_packus_epi16(_mm256_packs_epi32(q, q), q);
+            uint32_t *out = (uint32_t *)(dst + x * dst_pitch) + y;
+            out[0] = _mm_cvtsi128_si32(_mm256_castsi256_si128(q));
+            out[1] = _mm_cvtsi128_si32(_mm256_extracti128_si256(q, 1));
+
+            int i1 = (x + radius + 1 > w - 1) ? w - 1 : x + radius + 1;
+            int i2 = (x - radius < 0) ? 0 : x - radius;
+            k = _mm256_add_epi32(k, _mm256_sub_epi32(bmputils_unpack_avx2(in1[i1], in2[i1]), bmputils_unpack_avx2(in1[i2], in2[i2])));
+        }
+    }
+    if (y < y2)
+        bmputils_blur_rows_sse2(src, src_pitch, dst, dst_pitch, w, y, y2, radius, reciprocal);
+}
+#endif
+
+
+
+#ifdef __ARM_NEON
+/*
+ * NEON row kernel, same layout and reciprocal as the SSE2 one.
+ */
+static inline uint32x4_t bmputils_unpack_neon(uint32_t pixel) {
+    return vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(pixel)))));
+}
+
+static void bmputils_blur_rows_neon(const uint8_t *src, int src_pitch, uint8_t *dst, int dst_pitch, int w, int y1, int y2, int radius, uint32_t reciprocal) {
+    uint32x2_t mul = vdup_n_u32(reciprocal);
+
+    for (int y = y1; y < y2; y++) {
+        const uint32_t *in = (const uint32_t *)(src + y * src_pitch);
+        uint32x4_t k = vdupq_n_u32(0);
+
+        for (int i = -radius; i <= radius; i++)
+            k = vaddq_u32(k, bmputils_unpack_neon(in[utils_clampi(i, 0, w - 1)]));
+        for (int x = 0; x < w; x++) {
+            uint32x4_t q = vcombine_u32(vshrn_n_u64(vmull_u32(vget_low_u32(k), mul), 32), vshrn_n_u64(vmull_u32(vget_high_u32(k), mul), 32));
+            uint16x4_t q16 = vmovn_u32(q);
+            uint8x8_t q8 = vmovn_u16(vcombine_u16(q16, q16));
+            *((uint32_t *)(dst + x * dst_pitch) + y) = vget_lane_u32(vreinterpret_u32_u8(q8), 0);
+
+            int i1 = (x + radius + 1 > w - 1) ? w - 1 : x + radius + 1;
+            int i2 = (x - radius < 0) ? 0 : x - radius;
+            k = vsubq_u32(vaddq_u32(k, bmputils_unpack_neon(in[i1])), bmputils_unpack_neon(in[i2]));
+        }
+    }
+}
+#endif
+
+
+
+/*
+ * Picks the fastest row kernel for this CPU and radius.
+ */
+static BMPUTILS_BLUR_ROWS bmputils_blur_rows_select(int radius) {
+    if (radius < 1 || radius > BMPUTILS_MAX_SIMD_RADIUS)
+        return bmputils_blur_rows;
+#if defined(BMPUTILS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return bmputils_blur_rows_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return bmputils_blur_rows_sse2;
+#elif defined(__ARM_NEON)
+    return bmputils_blur_rows_neon;
+#endif
+    return bmputils_blur_rows;
+}
+
+
+
+/*
+ * Blurs the rows of a job one block at a time. The output of a block is a
+ * tile BMPUTILS_BLUR_BLOCK pixels wide, a cache line per destination row,
+ * which stays in cache until the block is done. Jobs start on block
+ * boundaries so that no two threads ever write to the same line.
+ */
+static void *bmputils_blur_job(ALLEGRO_THREAD *thread, void *arg) {
+    BMPUTILS_BLUR_JOB *job = arg;
+
+    for (int y = job->y1; y < job->y2; y += BMPUTILS_BLUR_BLOCK)
+        job->kernel(job->src, job->src_pitch, job->dst, job->dst_pitch, job->w, y, y + BMPUTILS_BLUR_BLOCK < job->y2 ? y + BMPUTILS_BLUR_BLOCK : job->y2, job->radius, job->reciprocal);
+    return NULL;
+}
+
+
+
+/*
+ * Takes jobs from the pool as they're posted, until the program exits.
+ */
+static void *bmputils_pool_worker(ALLEGRO_THREAD *thread, void *arg) {
+    BMPUTILS_POOL *pool = arg;
+
+    al_lock_mutex(pool->mutex);
+    for (;;) {
+        if (pool->next_job >= pool->job_count) {
+            al_wait_cond(pool->work, pool->mutex);
+            continue;
+        }
+        BMPUTILS_BLUR_JOB *job = &pool->jobs[pool->next_job++];
+        al_unlock_mutex(pool->mutex);
+        bmputils_blur_job(thread, job);
+        al_lock_mutex(pool->mutex);
+        if (--pool->pending == 0)
+            al_broadcast_cond(pool->done);
+    }
+    return NULL;
+}
+
+
+
+/*
+ * Runs the jobs on the pool, starting as many workers as still missing, and 
+ * returns once all of them are done. The calling thread takes jobs as well, 
+ * so every job gets done even if no worker could be started.
+ */
+static void bmputils_pool_run(BMPUTILS_BLUR_JOB *jobs, int count) {
+    BMPUTILS_POOL *pool = &bmputils_pool;
+
+    if (!pool->mutex) {
+        pool->mutex = al_create_mutex();
+        pool->work = al_create_cond();
+        pool->done = al_create_cond();
+    }
+    if (!pool->mutex || !pool->work || !pool->done) {
+        for (int i = 0; i < count; i++)
+            bmputils_blur_job(NULL, &jobs[i]);
+        return;
+    }
+    while (pool->thread_count < count - 1) {
+        ALLEGRO_THREAD *thread = al_create_thread(bmputils_pool_worker, pool);
+        if (!thread) break;
+        pool->threads[pool->thread_count++] = thread;
+        al_start_thread(thread);
+    }
+
+    al_lock_mutex(pool->mutex);
+    pool->jobs = jobs;
+    pool->job_count = count;
+    pool->next_job = 0;
+    pool->pending = count;
+    al_broadcast_cond(pool->work);
+    while (pool->next_job < pool->job_count) {
+        BMPUTILS_BLUR_JOB *job = &pool->jobs[pool->next_job++];
+        al_unlock_mutex(pool->mutex);
+        bmputils_blur_job(NULL, job);
+        al_lock_mutex(pool->mutex);
+        pool->pending--;
+    }
+    while (pool->pending > 0)
+        al_wait_cond(pool->done, pool->mutex);
+    pool->job_count = pool->next_job = 0;
+    al_unlock_mutex(pool->mutex);
+}
+
+
+
+/**
+ *  Sets the number of threads used to blur bitmaps
+ *
+ *  Zero, the default, uses one thread per CPU core up to
+ *  BMPUTILS_MAX_THREADS.
+ */
+void bmputils_set_threads(int count) {
+    bmputils_threads = utils_clampi(count, 0, BMPUTILS_MAX_THREADS);
+}
+
+
+
 /**
  *  Blurs and transposes a bitmap
  *
  *  Blurs and transposes the bitmap passed as a parameter. This filter is 
  *  useful since calling this function twice produces a box blur effect.
+ *  Rows are split among up to bmputils_set_threads() threads and blurred with
+ *  SSE2, AVX2 or NEON when available; every kernel produces exactly the same
+ *  pixels. The threads are kept between blurs, so blur from one thread at a 
+ *  time.
  */
 ALLEGRO_BITMAP *bmputils_transpose_blur(ALLEGRO_BITMAP *bmp, int radius) {
     ALLEGRO_BITMAP *target = NULL, *blur = NULL;
-    int *ioffset, *ooffset;
-    int kr, kg, kb, ka;
-    int i, x, y, w, h, t;
-    int irgb, orgb;
-    int in, out;
+    BMPUTILS_BLUR_JOB jobs[BMPUTILS_MAX_THREADS];
+    int w, h, blocks, count;
     int factor = radius * 2  + 1;
     ALLEGRO_LOCKED_REGION *ls, *ld;
 
@@ -72,42 +400,29 @@ ALLEGRO_BITMAP *bmputils_transpose_blur(ALLEGRO_BITMAP *bmp, int radius) {
     ls = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_RGBA_8888, ALLEGRO_LOCK_READONLY);
     ld = al_lock_bitmap(blur, ALLEGRO_PIXEL_FORMAT_RGBA_8888, ALLEGRO_LOCK_WRITEONLY);
 
-// Do a 1D horizontal blur and transpose the resulting image
-    in = 0;
-    for (y = 0; y < h; y++) {
-        out = y;
-        kr = 0; kg = 0; kb = 0; ka = 0;
-
-    // Get the initial horizontal kernel sum
-        ioffset = (int *)(ls->data + y * ls->pitch);
-        ooffset = (int *)(ld->data);
-        for (i = -radius; i <= radius; i++) {
-            irgb = *(ioffset + utils_clampi(i, 0, w - 1));
-            kr += (irgb >> 24) & 0xFF;
-            kg += (irgb >> 16) & 0xFF;
-            kb += (irgb >> 8) & 0xFF;
-            ka += irgb & 0xFF;
-        }
-        
-        t = 0;
-        for (x = 0; x < w; x++) {
-            int i1, i2, rgb1, rgb2;
-            
-            orgb = ((kr / factor) << 24) | ((kg / factor) << 16) | ((kb / factor) << 8) | (ka / factor);
-            *(ooffset + out) = orgb;
-            
-            i1 = (x + radius + 1 > w - 1) ? w - 1 : x + radius + 1;
-            i2 = (x - radius < 0) ? 0 : x - radius;
-            rgb1 = *(ioffset + i1);
-            rgb2 = *(ioffset + i2);
-            kr += ((rgb1 >> 24) & 0xff) - ((rgb2 >> 24) & 0xff);
-            kg += ((rgb1 & 0xff0000) - (rgb2 & 0xff0000)) >> 16;
-            kb += ((rgb1 & 0xff00) - (rgb2 & 0xff00)) >> 8;
-            ka += (rgb1 & 0xff) - (rgb2 & 0xff);
-            
-            ooffset = (int *)(ld->data + ++t * ld->pitch);
-        }
+// Do a 1D horizontal blur and transpose the resulting image, each thread
+// taking a run of whole blocks and at least BMPUTILS_MIN_THREAD_PIXELS
+    count = bmputils_threads > 0 ? bmputils_threads : utils_clampi(al_get_cpu_count(), 1, BMPUTILS_MAX_THREADS);
+    blocks = (h + BMPUTILS_BLUR_BLOCK - 1) / BMPUTILS_BLUR_BLOCK;
+    count = count < blocks ? count : blocks;
+    if ((int64_t)w * h < (int64_t)count * BMPUTILS_MIN_THREAD_PIXELS)
+        count = w * h / BMPUTILS_MIN_THREAD_PIXELS > 1 ? w * h / BMPUTILS_MIN_THREAD_PIXELS : 1;
+    for (int i = 0; i < count; i++) {
+        jobs[i].kernel = bmputils_blur_rows_select(radius);
+        jobs[i].src = ls->data;
+        jobs[i].src_pitch = ls->pitch;
+        jobs[i].dst = ld->data;
+        jobs[i].dst_pitch = ld->pitch;
+        jobs[i].w = w;
+        jobs[i].y1 = utils_clampi(blocks * i / count * BMPUTILS_BLUR_BLOCK, 0, h);
+        jobs[i].y2 = utils_clampi(blocks * (i + 1) / count * BMPUTILS_BLUR_BLOCK, 0, h);
+        jobs[i].radius = radius;
+        jobs[i].reciprocal = (uint32_t)((((uint64_t)1 << 32) + factor - 1) / factor);
     }
+    if (count > 1)
+        bmputils_pool_run(jobs, count);
+    else
+        bmputils_blur_job(NULL, &jobs[0]);
 
     al_unlock_bitmap(blur);
     al_unlock_bitmap(bmp);
@@ -129,3 +444,134 @@ ALLEGRO_BITMAP *bmputils_box_blur(ALLEGRO_BITMAP *bmp, int radius) {
     return blur;
 }
 
+
+
+
+/**
+ *  Box blurs a bitmap several times
+ *
+ *  Each pass uses a smaller radius so that all passes together spread the
+ *  image as much as a single box blur of the given radius. Three or more
+ *  passes closely approximate a gaussian blur.
+ */
+ALLEGRO_BITMAP *bmputils_box_blur_passes(ALLEGRO_BITMAP *bmp, int radius, int passes) {
+    ALLEGRO_BITMAP *blur = bmp;
+    int size;
+
+    if (!bmp) return NULL;
+    passes = passes < 1 ? 1 : passes;
+// Boxes of odd size n have variance (n * n - 1) / 12, variances add up
+    size = (int)(sqrt(((2 * radius + 1) * (2 * radius + 1) - 1.0) / passes + 1) + .5);
+    radius = (size - 1) / 2;
+    for (int i = 0; i < passes; i++) {
+        ALLEGRO_BITMAP *temp = bmputils_box_blur(blur, radius);
+        if (blur != bmp)
+            al_destroy_bitmap(blur);
+        if (!temp) return NULL;
+        blur = temp;
+    }
+    return blur;
+}
+
+
+
+/**
+ *  Downsamples a bitmap
+ *
+ *  Scales the bitmap passed as a parameter down to the given size, every
+ *  pixel of the result being the average of the source pixels it covers.
+ *  The size is clamped so that the bitmap is never scaled up.
+ */
+ALLEGRO_BITMAP *bmputils_downsample(ALLEGRO_BITMAP *bmp, int dw, int dh) {
+    ALLEGRO_BITMAP *target = NULL, *small = NULL;
+    ALLEGRO_LOCKED_REGION *ls, *ld;
+    uint32_t *sums;
+    int w, h;
+
+    if (!bmp) return NULL;
+
+    w = al_get_bitmap_width(bmp);
+    h = al_get_bitmap_height(bmp);
+    dw = utils_clampi(dw, 1, w);
+    dh = utils_clampi(dh, 1, h);
+    small = al_create_bitmap(dw, dh);
+    sums = calloc(dw * 4, sizeof(uint32_t));
+    if (!small || !sums) {
+        if (small) al_destroy_bitmap(small);
+        free(sums);
+        return NULL;
+    }
+    target = al_get_target_bitmap();
+    al_set_target_bitmap(small);
+
+    ls = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_RGBA_8888, ALLEGRO_LOCK_READONLY);
+    ld = al_lock_bitmap(small, ALLEGRO_PIXEL_FORMAT_RGBA_8888, ALLEGRO_LOCK_WRITEONLY);
+
+// Sum the source rows covered by every output row, two channels per 64-bit
+// word of a row sum first, which can't overflow for spans of up to 2^24
+// pixels, then into the 32-bit output sums
+    for (int y = 0; y < dh; y++) {
+        int y1 = (int64_t)y * h / dh, y2 = (int64_t)(y + 1) * h / dh;
+        uint32_t *out = (uint32_t *)(ld->data + y * ld->pitch);
+
+        memset(sums, 0, dw * 4 * sizeof(uint32_t));
+        for (int sy = y1; sy < y2; sy++) {
+            const uint32_t *in = (const uint32_t *)(ls->data + sy * ls->pitch);
+            for (int x = 0, sx = 0; x < dw; x++) {
+                int x2 = (int64_t)(x + 1) * w / dw;
+                uint64_t even = 0, odd = 0;
+                for (; sx < x2; sx++) {
+                    even += (in[sx] & 0xFF) | ((uint64_t)(in[sx] & 0xFF0000) << 16);
+                    odd += ((in[sx] >> 8) & 0xFF) | ((uint64_t)(in[sx] & 0xFF000000) << 8);
+                }
+                sums[x * 4] += (uint32_t)even, sums[x * 4 + 2] += even >> 32;
+                sums[x * 4 + 1] += (uint32_t)odd, sums[x * 4 + 3] += odd >> 32;
+            }
+        }
+        for (int x = 0; x < dw; x++) {
+            uint32_t count = (uint32_t)((int64_t)(x + 1) * w / dw - (int64_t)x * w / dw) * (y2 - y1);
+            out[x] = 0;
+            for (int c = 0; c < 4; c++)
+                out[x] |= ((sums[x * 4 + c] + count / 2) / count) << (8 * c);
+        }
+    }
+
+    al_unlock_bitmap(small);
+    al_unlock_bitmap(bmp);
+    al_set_target_bitmap(target);
+    free(sums);
+
+    return small;
+}
+
+
+
+/**
+ *  Blurs a bitmap that will be shown stretched to the given size
+ *
+ *  Downsamples the bitmap so that the blur radius, measured on the shown
+ *  size, spans BMPUTILS_FAST_BLUR_RADIUS pixels, then blurs the small bitmap
+ *  with the given number of box passes. The result is meant to be drawn
+ *  scaled up to the shown size with linear filtering, and costs the same for
+ *  any source size besides the single downsampling pass.
+ */
+ALLEGRO_BITMAP *bmputils_fast_blur(ALLEGRO_BITMAP *bmp, int radius, int width, int height, int passes) {
+    ALLEGRO_BITMAP *small = NULL, *blur = NULL;
+    int w, h, dw, dh;
+    double shown, factor;
+
+    if (!bmp) return NULL;
+
+    w = al_get_bitmap_width(bmp);
+    h = al_get_bitmap_height(bmp);
+// The radius on the shown size, and how much smaller than that to blur
+    shown = radius * (double)width / w;
+    factor = shown > BMPUTILS_FAST_BLUR_RADIUS ? shown / BMPUTILS_FAST_BLUR_RADIUS : 1;
+    dw = utils_clampi(width / factor + .5, 1, w);
+    dh = utils_clampi(height / factor + .5, 1, h);
+    small = bmputils_downsample(bmp, dw, dh);
+    if (!small) return NULL;
+    blur = bmputils_box_blur_passes(small, utils_clampi(radius * (double)dw / w + .5, 1, dw), passes);
+    al_destroy_bitmap(small);
+    return blur;
+}